@@ -1 +1,118 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: address_resolver.cpp
+// Description: This implementation file implements the address_resolver
+//              class that looks up and caches the socket addresses of hosts.
+// Public interfaces:
+//   * resolved_address
+//   * resolve_result
+//   * resolver_options
+//   * address_resolver
+// ============================================================================
+
+
 #include "address_resolver.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <utility>
+
+#include <netdb.h>
+
+using std::string;
+using crawler_pp::resolving::resolve_result;
+
+crawler_pp::resolving::address_resolver::address_resolver(const crawler_pp::resolving::resolver_options &options)
+  :options_(options), stopped_(false) {
+  for(unsigned i(0); i < std::max(1u, options.threads); ++i)
+    this->threads_.push_back(std::thread(&crawler_pp::resolving::address_resolver::run, this));
+}
+
+void crawler_pp::resolving::address_resolver::resolve(const string &host, const string &port,
+						      crawler_pp::resolving::address_resolver::callback done){
+  const string key(host + ":" + port);
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  std::unordered_map<string, entry>::iterator cached(this->cache_.find(key));
+  if(cached != this->cache_.end() && cached->second.expires > clock::now()) {
+    const resolve_result result(cached->second.result);
+    lock.unlock();
+    done(result);
+    return;
+  }
+  std::vector<callback> &callbacks(this->pending_[key]);
+  callbacks.push_back(std::move(done));
+  // Only the first request of a key starts a lookup
+  if(callbacks.size() == 1) {
+    this->queue_.push_back(key);
+    this->condition_.notify_one();
+  }
+}
+
+resolve_result crawler_pp::resolving::address_resolver::resolve(const string &host, const string &port){
+  std::shared_ptr<std::promise<resolve_result> > result(std::make_shared<std::promise<resolve_result> >());
+  this->resolve(host, port, [result](const resolve_result &value){ result->set_value(value); });
+  return result->get_future().get();
+}
+
+void crawler_pp::resolving::address_resolver::run(){
+  while(true) {
+    string key;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->condition_.wait(lock, [this]{ return this->stopped_ || !this->queue_.empty(); });
+      if(this->stopped_) return;
+      key = std::move(this->queue_.front());
+      this->queue_.pop_front();
+    }
+
+    // The port follows the last colon, IPv6 hosts are passed without
+    // brackets
+    const size_t colon(key.rfind(':'));
+    const string host(key.substr(0, colon)), port(key.substr(colon + 1));
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    addrinfo *list(nullptr);
+    resolve_result result;
+    result.error = getaddrinfo(host.c_str(), port.c_str(), &hints, &list);
+    for(addrinfo *info(list); !result.error && info; info = info->ai_next) {
+      resolved_address address;
+      std::memset(&address.address, 0, sizeof(address.address));
+      std::memcpy(&address.address, info->ai_addr, info->ai_addrlen);
+      address.length = info->ai_addrlen;
+      result.addresses.push_back(address);
+    }
+    if(list) freeaddrinfo(list);
+    if(!result.error && result.addresses.empty()) result.error = EAI_NONAME;
+
+    std::vector<callback> callbacks;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      if(this->cache_.size() >= this->options_.max_entries) {
+	const clock::time_point now(clock::now());
+	for(std::unordered_map<string, entry>::iterator i(this->cache_.begin()); i != this->cache_.end(); )
+	  i = i->second.expires <= now ? this->cache_.erase(i) : ++i;
+	if(this->cache_.size() >= this->options_.max_entries) this->cache_.clear();
+      }
+      entry &cached(this->cache_[key]);
+      cached.expires = clock::now() + (result.error ? this->options_.negative_ttl : this->options_.ttl);
+      cached.result = result;
+      callbacks.swap(this->pending_[key]);
+      this->pending_.erase(key);
+    }
+    for(size_t i(0); i != callbacks.size(); ++i) callbacks[i](result);
+  }
+}
+
+crawler_pp::resolving::address_resolver::~address_resolver(){
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stopped_ = true;
+  }
+  this->condition_.notify_all();
+  for(size_t i(0); i != this->threads_.size(); ++i) this->threads_[i].join();
+}
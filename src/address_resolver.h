@@ -1,5 +1,156 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: address_resolver.h
+// Description: This header file defines the address_resolver class that
+//              looks up the socket addresses of hosts. The lookups run on a
+//              small pool of threads, since getaddrinfo blocks, and their
+//              results are cached. Coroutines await a lookup by
+//              async_resolve (C++20 only).
+// Public interfaces:
+//   * resolved_address
+//   * resolve_result
+//   * resolver_options
+//   * address_resolver
+//   * resolve_awaiter
+//   * async_resolve
+// ============================================================================
+
+
 #ifndef ADDRESS_RESOLVER_H
 #define ADDRESS_RESOLVER_H
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+#if __cplusplus >= 202002L
+  #include "event_loop.h"
+
+  #include <atomic>
+  #include <coroutine>
+#endif
+
+namespace crawler_pp {
+  namespace resolving {
+
+    // A single socket address of a host
+    struct resolved_address {
+      sockaddr_storage address;
+      socklen_t length;
+    }; // end of struct resolved_address
+
+    // The outcome of a lookup
+    struct resolve_result {
+      // 0 or the EAI_* error code of getaddrinfo
+      int error = 0;
+      // The addresses of the host in the order of getaddrinfo
+      std::vector<resolved_address> addresses;
+    }; // end of struct resolve_result
+
+    // Bundles all parameters of an address_resolver.
+    struct resolver_options {
+      // The number of threads that call getaddrinfo
+      unsigned threads = 4;
+      // The time a successful lookup is cached
+      std::chrono::seconds ttl = std::chrono::seconds(300);
+      // The time a failed lookup is cached
+      std::chrono::seconds negative_ttl = std::chrono::seconds(30);
+      // The cache is purged as soon as it has more entries
+      size_t max_entries = 1 << 16;
+    }; // end of struct resolver_options
+
+    // This class looks up hosts on its own threads. Concurrent lookups of
+    // the same host and port share a single getaddrinfo call. All methods
+    // are thread safe.
+    class address_resolver {
+    public:
+      typedef std::chrono::steady_clock clock;
+      typedef std::function<void(const resolve_result&)> callback;
+
+      // This constructor starts the lookup threads.
+      address_resolver(const resolver_options& = resolver_options());
+      // An address_resolver cannot be copied, since it owns threads.
+      address_resolver(const address_resolver&) = delete;
+      address_resolver& operator=(const address_resolver&) = delete;
+      // Looks up the passed host and port (or service name) and passes the
+      // result to the callback. A cached result is passed immediately on the
+      // calling thread, otherwise the callback is called by a lookup thread.
+      void resolve(const std::string &host, const std::string &port, callback);
+      // Looks up the passed host and port and blocks until the result is
+      // available.
+      resolve_result resolve(const std::string &host, const std::string &port);
+      // The destructor stops the lookup threads, pending callbacks are not
+      // called.
+      ~address_resolver();
+    private:
+      // A cached lookup
+      struct entry {
+	clock::time_point expires;
+	resolve_result result;
+      };
+
+      // The function of the lookup threads
+      void run();
+
+      resolver_options options_;
+      std::mutex mutex_;
+      std::condition_variable condition_;
+      bool stopped_;
+      // The keys ("host:port") that wait for a lookup thread
+      std::deque<std::string> queue_;
+      // The callbacks of the keys that are queued or looked up
+      std::unordered_map<std::string, std::vector<callback> > pending_;
+      std::unordered_map<std::string, entry> cache_;
+      std::vector<std::thread> threads_;
+    }; // end of class address_resolver
+
+#if __cplusplus >= 202002L
+    // The awaitable of async_resolve. co_await returns the resolve_result,
+    // the awaiting coroutine is resumed on its own event loop.
+    class resolve_awaiter {
+    public:
+      resolve_awaiter(address_resolver &resolver, std::string host, std::string port)
+	:resolver_(resolver), host_(std::move(host)), port_(std::move(port)), ready_(false) {}
+      bool await_ready() const noexcept {
+	return false;
+      }
+      bool await_suspend(std::coroutine_handle<> handle){
+	crawler_pp::async::event_loop *loop(crawler_pp::async::event_loop::current());
+	// Either the callback or this method finishes second and decides
+	// whether the coroutine is suspended
+	this->resolver_.resolve(this->host_, this->port_, [this, handle, loop](const resolve_result &result){
+	    this->result_ = result;
+	    if(this->ready_.exchange(true)) loop->post(handle);
+	  });
+	return !this->ready_.exchange(true);
+      }
+      resolve_result await_resume(){
+	return std::move(this->result_);
+      }
+    private:
+      address_resolver &resolver_;
+      std::string host_;
+      std::string port_;
+      std::atomic<bool> ready_;
+      resolve_result result_;
+    }; // end of class resolve_awaiter
+
+    // Returns an awaitable that looks up the passed host and port by the
+    // passed resolver. It must be awaited on the thread of an event loop.
+    inline resolve_awaiter async_resolve(address_resolver &resolver, const std::string &host,
+					 const std::string &port){
+      return resolve_awaiter(resolver, host, port);
+    }
+#endif
+  } // end of namespace resolving
+} // end of namespace crawler_pp
 
 #endif // ADDRESS_RESOLVER_H
@@ -0,0 +1,101 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: bounded_queue.h
+// Description: This header file defines the bounded_queue class template, a
+//              lock-free multi-producer multi-consumer queue with a fixed
+//              capacity (see D. Vyukov, "Bounded MPMC queue").
+// Public interfaces:
+//   * bounded_queue
+// ============================================================================
+
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace crawler_pp {
+  namespace utils {
+
+    // A lock-free queue of T instances. The capacity is rounded up to the
+    // next power of two. T must be default constructible and movable.
+    template<typename T>
+    class bounded_queue {
+    public:
+      // This constructor takes the minimum capacity of the queue.
+      explicit bounded_queue(size_t capacity) :mask_(0), enqueue_pos_(0), dequeue_pos_(0) {
+	size_t size(2);
+	while(size < capacity) size <<= 1;
+	this->mask_ = size - 1;
+	this->cells_.reset(new cell[size]);
+	for(size_t i(0); i != size; ++i) this->cells_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      bounded_queue(const bounded_queue&) = delete;
+      bounded_queue& operator=(const bounded_queue&) = delete;
+      // Moves the passed value into the queue. Returns false if the queue is
+      // full, the value is not moved then.
+      bool try_push(T &value){
+	size_t pos(this->enqueue_pos_.load(std::memory_order_relaxed));
+	cell *target;
+	while(true) {
+	  target = &this->cells_[pos & this->mask_];
+	  const size_t sequence(target->sequence.load(std::memory_order_acquire));
+	  const std::ptrdiff_t diff(static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos));
+	  if(!diff) {
+	    if(this->enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+	  } else if(diff < 0) {
+	    return false;
+	  } else {
+	    pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+	  }
+	}
+	target->data = std::move(value);
+	target->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+      }
+      // Moves the oldest value of the queue into the passed value. Returns
+      // false if the queue is empty.
+      bool try_pop(T &value){
+	size_t pos(this->dequeue_pos_.load(std::memory_order_relaxed));
+	cell *source;
+	while(true) {
+	  source = &this->cells_[pos & this->mask_];
+	  const size_t sequence(source->sequence.load(std::memory_order_acquire));
+	  const std::ptrdiff_t diff(static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1));
+	  if(!diff) {
+	    if(this->dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+	  } else if(diff < 0) {
+	    return false;
+	  } else {
+	    pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+	  }
+	}
+	value = std::move(source->data);
+	source->data = T();
+	source->sequence.store(pos + this->mask_ + 1, std::memory_order_release);
+	return true;
+      }
+      // Returns the capacity of the queue.
+      size_t capacity() const {
+	return this->mask_ + 1;
+      }
+    private:
+      struct cell {
+	std::atomic<size_t> sequence;
+	T data;
+      };
+
+      std::unique_ptr<cell[]> cells_;
+      size_t mask_;
+      // The positions are written by different threads, so they are kept
+      // on different cache lines
+      alignas(64) std::atomic<size_t> enqueue_pos_;
+      alignas(64) std::atomic<size_t> dequeue_pos_;
+    }; // end of class bounded_queue
+  } // end of namespace utils
+} // end of namespace crawler_pp
+
+#endif // BOUNDED_QUEUE_H
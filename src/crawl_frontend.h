@@ -0,0 +1,183 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: crawl_frontend.h
+// Description: This header file defines the crawl_frontend class template
+//              that admits discovered uris to a crawl. The behavior of the
+//              front end is defined by a crawl policy (see crawl_policy.h),
+//              i.e. all checks are resolved at compile time and the frontier
+//              backend and the dedup strategy are called directly.
+// Public interfaces:
+//   * crawl_frontend
+//   * default_crawl_frontend
+// ============================================================================
+
+
+#ifndef CRAWL_FRONTEND_H
+#define CRAWL_FRONTEND_H
+
+#include "crawl_policy.h"
+#include "exceptions.h"
+#include "uri.h"
+#include "utils.h"
+
+#include <network/uri.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace crawler_pp {
+  namespace policies {
+
+    // This class admits uris to a crawl that is configured by the type
+    // parameter Policy (see crawler_pp::policies::crawl_policy).
+    template<typename Policy>
+    class crawl_frontend {
+    public:
+      typedef typename Policy::scheme_policy scheme_policy;
+      typedef typename Policy::max_size_policy max_size_policy;
+      typedef typename Policy::normalization_policy normalization_policy;
+      typedef typename Policy::frontier_type frontier_type;
+      typedef typename Policy::dedup_type dedup_type;
+      typedef typename Policy::canonicalizer_type canonicalizer_type;
+
+      // The default constructor default constructs the frontier backend, the
+      // dedup strategy and the canonicalizer.
+      crawl_frontend() = default;
+      // This constructor takes the frontier backend and the dedup strategy
+      // that are used by this front end.
+      crawl_frontend(frontier_type &&frontier, dedup_type &&dedup)
+	:frontier_(std::move(frontier)), dedup_(std::move(dedup)) {}
+      // This constructor takes the frontier backend, the dedup strategy and
+      // the canonicalizer that are used by this front end.
+      crawl_frontend(frontier_type &&frontier, dedup_type &&dedup, canonicalizer_type &&canonicalizer)
+	:frontier_(std::move(frontier)), dedup_(std::move(dedup)), canonicalizer_(std::move(canonicalizer)) {}
+      // Returns the normalized value of the passed uri-string. If the uri is
+      // not absolute, too long or has an unsupported scheme the
+      // crawler_pp::exceptions::uri_exception is thrown.
+      static std::string normalize(const std::string &uri){
+	try {
+	  network::uri tmp(normalization_policy::apply(network::uri(uri)));
+	  if(!tmp.is_absolute() || tmp.empty())
+	    throw crawler_pp::exceptions::uri_exception("Uri must be absolute!", uri);
+	  std::string result(crawler_pp::utils::to_string<network::uri>(tmp));
+	  if(!max_size_policy::accepts(result.size()))
+	    throw crawler_pp::exceptions::uri_exception("Uri must be shorter or equal to " +
+							std::to_string(max_size_policy::limit()) +
+							" characters!", uri);
+	  if(!scheme_policy::is_supported(tmp.scheme().get()))
+	    throw crawler_pp::exceptions::uri_exception("The scheme " +
+							static_cast<std::string>(tmp.scheme().get()) +
+							" is not supported!", uri);
+	  return result;
+	} catch(crawler_pp::exceptions::uri_exception&){
+	  throw;
+	} catch(std::exception &e){
+	  throw crawler_pp::exceptions::uri_exception(e.what(), uri);
+	} catch(...) {
+	  throw crawler_pp::exceptions::uri_exception("Could not create uri from string!", uri);
+	}
+      }
+      // Normalizes and canonicalizes the passed uri-string and pushes it to
+      // the frontier if it is not known by the dedup strategy yet and the
+      // canonicalizer admits it, deferred uris that the canonicalizer admits
+      // now are pushed as well. Returns true if the passed uri was pushed to
+      // the frontier. If the uri is invalid the
+      // crawler_pp::exceptions::uri_exception is thrown.
+      bool admit(const std::string &uri){
+	std::string value(normalize(uri));
+	this->canonicalizer_.canonicalize(value);
+	const bool pushed(!this->dedup_.is_known(value) && this->canonicalizer_.admit(value) &&
+			  this->frontier_.push(crawler_pp::data::waiting_uri(std::move(value),
+									     crawler_pp::data::uri::normalized_value())));
+	this->push_released();
+	return pushed;
+      }
+      // Pushes all passed uri-strings, that must be normalized already (see
+      // normalize), which are not known by the dedup strategy and are
+      // admitted by the canonicalizer to the frontier as a single batch.
+      // Returns the number of passed uris that were pushed, the deferred uris
+      // that the canonicalizer admits now are pushed but not counted.
+      size_t admit_batch(std::vector<std::string> &&values){
+	std::vector<crawler_pp::data::waiting_uri> uris;
+	uris.reserve(values.size());
+	for(size_t i(0); i != values.size(); ++i) {
+	  this->canonicalizer_.canonicalize(values[i]);
+	  if(!this->dedup_.is_known(values[i]) && this->canonicalizer_.admit(values[i]))
+	    uris.push_back(crawler_pp::data::waiting_uri(std::move(values[i]),
+							 crawler_pp::data::uri::normalized_value()));
+	}
+	const size_t pushed(this->frontier_.push(std::move(uris)));
+	this->push_released();
+	return pushed;
+      }
+      // Returns true if the passed uri-string is known by the dedup strategy.
+      bool is_known(const std::string &uri){
+	std::string value(normalize(uri));
+	this->canonicalizer_.canonicalize(value);
+	return this->dedup_.is_known(value);
+      }
+      // Marks the passed uri as visited by inserting it into the dedup
+      // strategy. Returns true if the uri was not known before.
+      bool mark_visited(const crawler_pp::data::uri &uri){
+	std::string value(uri.get_value());
+	this->canonicalizer_.canonicalize(value);
+	return this->dedup_.insert(value);
+      }
+      // Passes the content fingerprint (see crawler_pp::utils::simhash) of
+      // the fetched page with the passed normalized uri-string to the
+      // canonicalizer.
+      void observe(const std::string &uri, uint64_t fingerprint){
+	this->canonicalizer_.observe(uri, fingerprint);
+      }
+      // Returns true if the frontier contains a waiting uri.
+      bool has_next(){
+	return this->frontier_.has_next();
+      }
+      // Returns the next waiting uri of the frontier.
+      crawler_pp::data::waiting_uri get_next(){
+	return this->frontier_.get_next();
+      }
+      // A getter for the member frontier_
+      frontier_type& get_frontier(){
+	return this->frontier_;
+      }
+      // A getter for the member dedup_
+      dedup_type& get_dedup(){
+	return this->dedup_;
+      }
+      // A getter for the member canonicalizer_
+      canonicalizer_type& get_canonicalizer(){
+	return this->canonicalizer_;
+      }
+    private:
+      // Pushes the deferred uris that the canonicalizer admits now and that
+      // are not known by the dedup strategy to the frontier.
+      void push_released(){
+	std::vector<std::string> values;
+	this->canonicalizer_.release(values);
+	std::vector<crawler_pp::data::waiting_uri> uris;
+	for(size_t i(0); i != values.size(); ++i)
+	  if(!this->dedup_.is_known(values[i]))
+	    uris.push_back(crawler_pp::data::waiting_uri(std::move(values[i]),
+							 crawler_pp::data::uri::normalized_value()));
+	if(!uris.empty()) this->frontier_.push(std::move(uris));
+      }
+
+      // The frontier backend that stores all waiting uris
+      frontier_type frontier_;
+      // The dedup strategy that stores all visited uris
+      dedup_type dedup_;
+      // The canonicalizer that rewrites and filters the uris per host
+      canonicalizer_type canonicalizer_;
+    }; // end of class crawl_frontend
+
+    // The front end that reflects the runtime configuration of the uri
+    // classes, see crawler_pp::policies::default_crawl_policy.
+    typedef crawl_frontend<default_crawl_policy> default_crawl_frontend;
+  } // end of namespace policies
+} // end of namespace crawler_pp
+
+#endif // CRAWL_FRONTEND_H
@@ -0,0 +1,229 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: crawl_pipeline.cpp
+// Description: This implementation file implements the crawl_pipeline class
+//              whose fetches run as coroutines. This file requires C++20.
+// Public interfaces:
+//   * pipeline_options
+//   * pipeline_stats
+//   * crawl_pipeline
+// ============================================================================
+
+
+#include "crawl_pipeline.h"
+#include "event_loop.h"
+#include "link_extractor.h"
+#include "page_downloader.h"
+#include "uri.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <future>
+#include <utility>
+
+using std::string;
+using crawler_pp::async::event_loop;
+using crawler_pp::async::task;
+
+namespace {
+  // Splits the authority of the passed uri into host and port, the port
+  // defaults to the one of the scheme.
+  void split_authority(const string &uri, string &host, string &port){
+    host = crawler_pp::utils::uri_authority(uri);
+    port = uri.compare(0, 8, "https://") ? "80" : "443";
+    const size_t bracket(host.rfind(']'));
+    const size_t colon(host.rfind(':'));
+    if(colon != string::npos && (bracket == string::npos || colon > bracket)) {
+      if(colon + 1 != host.size()) port = host.substr(colon + 1);
+      host.erase(colon);
+    }
+    // IPv6 literals are resolved without brackets
+    if(!host.empty() && host[0] == '[') host = host.substr(1, host.size() - 2);
+  }
+
+  // Releases the request slot of a host that was acquired by
+  // scheduler::try_acquire. Unless the download result is passed by release,
+  // e.g. since the fetch threw, the slot is released as a failed request.
+  struct slot_guard {
+    void release(const crawler_pp::download::download_result &result){
+      this->released = true;
+      this->scheduler.release(this->uri, result);
+    }
+    ~slot_guard(){
+      if(!this->released)
+	this->scheduler.release(this->uri, crawler_pp::download::download_result{0, std::chrono::milliseconds(0),
+										 std::chrono::seconds(0)});
+    }
+    crawler_pp::scheduling::scheduler &scheduler;
+    const crawler_pp::data::waiting_uri &uri;
+    bool released;
+  }; // end of struct slot_guard
+
+  // Raises the passed maximum to the passed value.
+  void update_peak(std::atomic<uint64_t> &peak, uint64_t value){
+    uint64_t current(peak.load());
+    while(current < value && !peak.compare_exchange_weak(current, value)) {}
+  }
+} // end of anonymous namespace
+
+// The coroutines of the pipeline. They are members of a nested type to
+// access the private members of crawl_pipeline while the header stays free
+// of C++20 types.
+struct crawler_pp::scheduling::crawl_pipeline::stages {
+  // Takes the uris from the source and starts a fetch for each one as long
+  // as a slot is available, done is set when the last fetch is complete.
+  static task<void> dispatch(crawl_pipeline &pipeline, event_loop &loop, std::promise<void> &done){
+    co_await loop.schedule();
+    const uint64_t max_fetches(pipeline.options_.max_fetches);
+    while(!max_fetches || pipeline.started_.load() < max_fetches) {
+      co_await pipeline.slots_->acquire();
+      // A fetch in flight may still push uris to the source, so the source is
+      // exhausted only if it is empty while no fetch was in flight before
+      const uint64_t busy(pipeline.in_flight_.load());
+      string uri;
+      if(!pipeline.source_(uri)) {
+	pipeline.slots_->release();
+	if(!busy) break;
+	co_await loop.sleep_for(pipeline.options_.idle_wait);
+	continue;
+      }
+      ++pipeline.started_;
+      update_peak(pipeline.peak_in_flight_, ++pipeline.in_flight_);
+      crawler_pp::async::spawn(crawl(pipeline, pipeline.loops_->next(), std::move(uri)));
+    }
+    while(pipeline.in_flight_.load()) co_await loop.sleep_for(pipeline.options_.idle_wait);
+    done.set_value();
+  }
+
+  // Runs a single fetch on the passed loop and frees its slot.
+  static task<void> crawl(crawl_pipeline &pipeline, event_loop &loop, string uri){
+    co_await loop.schedule();
+    try {
+      co_await fetch(pipeline, loop, uri);
+    } catch(...) {
+      ++pipeline.failed_;
+    }
+    --pipeline.in_flight_;
+    pipeline.slots_->release();
+  }
+
+  // The lifecycle of a fetch: schedule, resolve, download, extract, persist
+  static task<void> fetch(crawl_pipeline &pipeline, event_loop &loop, const string &value){
+    if(value.compare(0, 7, "http://")) {
+      ++pipeline.unsupported_;
+      co_return;
+    }
+    const crawler_pp::data::waiting_uri uri(value, crawler_pp::data::uri::normalized_value());
+    while(!pipeline.scheduler_.try_acquire(uri)) {
+      // The host is delayed or has its maximum of requests in flight
+      const event_loop::clock::time_point now(event_loop::clock::now());
+      co_await loop.sleep_until(std::max(pipeline.scheduler_.next_allowed(uri), now + std::chrono::milliseconds(5)));
+    }
+    slot_guard slot{pipeline.scheduler_, uri, false};
+
+    string host, port;
+    split_authority(value, host, port);
+    const crawler_pp::resolving::resolve_result address(co_await crawler_pp::resolving::async_resolve(pipeline.resolver_,
+												     host, port));
+    if(address.error) {
+      ++pipeline.unresolved_;
+      co_return;
+    }
+
+    crawler_pp::download::fetch_options options;
+    options.max_size = pipeline.options_.max_page_size;
+    options.timeout = pipeline.options_.timeout;
+    options.user_agent = pipeline.options_.user_agent;
+    std::chrono::system_clock::time_point date;
+    crawler_pp::download::fetch_response response;
+    // An unreachable address, e.g. an IPv6 address without route, is
+    // skipped for the next address of the host
+    for(size_t i(0); i != address.addresses.size() && !response.connected; ++i) {
+      date = std::chrono::system_clock::now();
+      response = co_await crawler_pp::download::async_fetch(address.addresses[i], value, options);
+    }
+    slot.release(response.result);
+    if(!response.result.status) {
+      ++pipeline.failed_;
+      co_return;
+    }
+    ++pipeline.fetched_;
+    pipeline.bytes_ += response.message.size();
+
+    crawler_pp::download::http_response parsed;
+    crawler_pp::download::parse_http_response(response.message.data(), response.message.size(), parsed);
+    const string mime(parsed.get_header("Content-Type"));
+    std::vector<string> links;
+    uint64_t content(0);
+    if(crawler_pp::extraction::extract_page(parsed, value, content, links)) pipeline.links_ += links.size();
+    pipeline.sink_(value, parsed.status, content, links);
+
+    if(!pipeline.storage_) co_return;
+    crawler_pp::storage::fetch_record record;
+    record.target_uri = value;
+    record.date = date;
+    record.request = std::move(response.request);
+    record.response_length = response.message.size();
+    record.response = crawler_pp::warc::string_source(std::move(response.message));
+    record.status = parsed.status;
+    record.mime = mime;
+    co_await crawler_pp::storage::async_store(*pipeline.storage_, std::move(record));
+    ++pipeline.stored_;
+  }
+}; // end of struct stages
+
+crawler_pp::scheduling::crawl_pipeline::crawl_pipeline(const crawler_pp::scheduling::pipeline_options &options,
+						       crawler_pp::scheduling::scheduler &scheduler,
+						       crawler_pp::resolving::address_resolver &resolver,
+						       crawler_pp::storage::storage_controller *storage,
+						       source source, sink sink)
+  :options_(options), scheduler_(scheduler), resolver_(resolver), storage_(storage), source_(std::move(source)),
+   sink_(std::move(sink)), loops_(new crawler_pp::async::loop_pool(options.threads)),
+   slots_(new crawler_pp::async::async_semaphore(std::max<size_t>(1, options.max_in_flight))), in_flight_(0),
+   started_(0), fetched_(0), failed_(0), unresolved_(0), unsupported_(0), bytes_(0), links_(0), stored_(0),
+   peak_in_flight_(0), elapsed_(0) {}
+
+void crawler_pp::scheduling::crawl_pipeline::run(){
+  const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+  std::promise<void> done;
+  std::future<void> finished(done.get_future());
+  crawler_pp::async::spawn(stages::dispatch(*this, this->loops_->next(), done));
+  finished.wait();
+  const std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start);
+  this->elapsed_.store(this->elapsed_.load() + elapsed.count());
+}
+
+crawler_pp::scheduling::pipeline_stats crawler_pp::scheduling::crawl_pipeline::get_stats() const {
+  pipeline_stats stats;
+  stats.started = this->started_.load();
+  stats.fetched = this->fetched_.load();
+  stats.failed = this->failed_.load();
+  stats.unresolved = this->unresolved_.load();
+  stats.unsupported = this->unsupported_.load();
+  stats.bytes = this->bytes_.load();
+  stats.links = this->links_.load();
+  stats.stored = this->stored_.load();
+  stats.peak_in_flight = this->peak_in_flight_.load();
+  stats.elapsed = std::chrono::duration<double>(this->elapsed_.load());
+  return stats;
+}
+
+crawler_pp::scheduling::crawl_pipeline::~crawl_pipeline(){
+  this->loops_->stop();
+}
+
+std::ostream& crawler_pp::scheduling::operator<<(std::ostream &os, const crawler_pp::scheduling::pipeline_stats &stats){
+  os << "started: " << stats.started << "\n"
+     << "fetched: " << stats.fetched << "\n"
+     << "failed: " << stats.failed << "\n"
+     << "unresolved: " << stats.unresolved << "\n"
+     << "unsupported: " << stats.unsupported << "\n"
+     << "bytes: " << stats.bytes << "\n"
+     << "links: " << stats.links << "\n"
+     << "stored: " << stats.stored << "\n"
+     << "peak in flight: " << stats.peak_in_flight << "\n"
+     << "seconds: " << stats.elapsed.count() << "\n"
+     << "fetches/sec: " << stats.fetches_per_second() << "\n"
+     << "peak memory (KiB): " << crawler_pp::utils::peak_memory_usage() << "\n";
+  return os;
+}
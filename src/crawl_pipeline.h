@@ -0,0 +1,155 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: crawl_pipeline.h
+// Description: This header file defines the crawl_pipeline class that runs
+//              the lifecycle of each fetch (dequeue, resolve, connect,
+//              download, extract, persist) as a coroutine on a small pool of
+//              event loops. The coroutines are implemented in C++20 by
+//              crawl_pipeline.cpp, this header can be used by C++11 code.
+// Public interfaces:
+//   * pipeline_options
+//   * pipeline_stats
+//   * crawl_pipeline
+// ============================================================================
+
+
+#ifndef CRAWL_PIPELINE_H
+#define CRAWL_PIPELINE_H
+
+#include "address_resolver.h"
+#include "scheduler.h"
+#include "storage_controller.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace crawler_pp {
+  namespace async {
+    class loop_pool;
+    class async_semaphore;
+  } // end of namespace async
+
+  namespace scheduling {
+
+    // Bundles all parameters of a crawl_pipeline.
+    struct pipeline_options {
+      // The number of event loops, i.e. of threads that run the fetches
+      unsigned threads = 4;
+      // The maximum number of fetches in flight; further uris are not taken
+      // from the source until a fetch is complete
+      size_t max_in_flight = 10000;
+      // The maximum number of fetches, 0 runs the pipeline until the source
+      // is exhausted
+      uint64_t max_fetches = 0;
+      // Larger responses are truncated
+      size_t max_page_size = 8 << 20;
+      // The maximum time from connecting until a response is complete
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(30000);
+      // The time the pipeline waits if the source is empty but fetches are
+      // in flight
+      std::chrono::milliseconds idle_wait = std::chrono::milliseconds(10);
+      // The value of the User-Agent header
+      std::string user_agent = "crawler_pp";
+    }; // end of struct pipeline_options
+
+    // The counters of a crawl_pipeline
+    struct pipeline_stats {
+      // The uris taken from the source
+      uint64_t started = 0;
+      // The responses received (any status code)
+      uint64_t fetched = 0;
+      // The requests that failed by a network error or timeout
+      uint64_t failed = 0;
+      // The hosts that could not be resolved
+      uint64_t unresolved = 0;
+      // The uris with a scheme that is not supported (HTTPS)
+      uint64_t unsupported = 0;
+      // The size of all responses in bytes
+      uint64_t bytes = 0;
+      // The links extracted from HTML responses
+      uint64_t links = 0;
+      // The responses passed to the storage_controller
+      uint64_t stored = 0;
+      // The maximum number of fetches in flight at once
+      uint64_t peak_in_flight = 0;
+      // The time spent in crawl_pipeline::run
+      std::chrono::duration<double> elapsed = std::chrono::duration<double>(0);
+      // Returns the number of responses per second.
+      double fetches_per_second() const {
+	return this->elapsed.count() > 0 ? this->fetched / this->elapsed.count() : 0;
+      }
+    }; // end of struct pipeline_stats
+
+    // Writes the passed pipeline_stats to the given ostream.
+    std::ostream& operator<<(std::ostream&, const pipeline_stats&);
+
+    // This class crawls the uris of a source. Each uri is fetched by its own
+    // coroutine: it waits until the scheduler allows the request, awaits the
+    // address_resolver, downloads the page on a non-blocking socket, passes
+    // the extracted links to the sink and awaits the storage_controller. The
+    // number of coroutines is bounded by pipeline_options::max_in_flight, a
+    // full storage queue suspends the coroutines that want to store.
+    class crawl_pipeline {
+    public:
+      // Stores the next normalized uri to crawl in the passed string and
+      // returns true, or returns false if no uri is waiting at the moment.
+      // The source is called by a single thread at a time.
+      typedef std::function<bool(std::string&)> source;
+      // Receives the uri and the HTTP status code of each response, the
+      // content fingerprint (see crawler_pp::utils::simhash, 0 unless the
+      // response is an HTML page with status 200) and the links of HTML
+      // pages (not normalized). The sink is called by several threads
+      // concurrently.
+      typedef std::function<void(const std::string&, int, uint64_t, std::vector<std::string>&)> sink;
+
+      // This constructor takes the parameters of the pipeline, the
+      // components of the fetches (the storage_controller may be a nullptr
+      // if no responses are stored), the source of all uris and the sink of
+      // all extracted links. The event loops are started immediately.
+      crawl_pipeline(const pipeline_options&, scheduler&, crawler_pp::resolving::address_resolver&,
+		     crawler_pp::storage::storage_controller*, source, sink);
+      // A crawl_pipeline cannot be copied, since it owns the event loops.
+      crawl_pipeline(const crawl_pipeline&) = delete;
+      crawl_pipeline& operator=(const crawl_pipeline&) = delete;
+      // Crawls until the source is exhausted and no fetch is in flight or
+      // pipeline_options::max_fetches uris were taken, blocks the calling
+      // thread.
+      void run();
+      // Returns the current counters, this method is thread safe.
+      pipeline_stats get_stats() const;
+      // The destructor stops the event loops.
+      ~crawl_pipeline();
+    private:
+      // The coroutines of the pipeline, see crawl_pipeline.cpp
+      struct stages;
+
+      pipeline_options options_;
+      scheduler &scheduler_;
+      crawler_pp::resolving::address_resolver &resolver_;
+      crawler_pp::storage::storage_controller *storage_;
+      source source_;
+      sink sink_;
+      std::unique_ptr<crawler_pp::async::loop_pool> loops_;
+      std::unique_ptr<crawler_pp::async::async_semaphore> slots_;
+      std::atomic<uint64_t> in_flight_;
+      std::atomic<uint64_t> started_;
+      std::atomic<uint64_t> fetched_;
+      std::atomic<uint64_t> failed_;
+      std::atomic<uint64_t> unresolved_;
+      std::atomic<uint64_t> unsupported_;
+      std::atomic<uint64_t> bytes_;
+      std::atomic<uint64_t> links_;
+      std::atomic<uint64_t> stored_;
+      std::atomic<uint64_t> peak_in_flight_;
+      std::atomic<double> elapsed_;
+    }; // end of class crawl_pipeline
+  } // end of namespace scheduling
+} // end of namespace crawler_pp
+
+#endif // CRAWL_PIPELINE_H
@@ -0,0 +1,290 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: crawl_policy.h
+// Description: This header file defines the policy classes that configure a
+//              crawl at compile time. A crawl policy bundles the supported
+//              URI schemes, the max URI length, the normalization level, the
+//              frontier backend, the dedup strategy and the canonicalizer
+//              that rewrites and filters uris per host. All checks of a
+//              policy are resolved at compile time, so the hot path of
+//              crawler_pp::policies::crawl_frontend inlines to direct calls.
+// Public interfaces:
+//   * http_schemes
+//   * runtime_schemes
+//   * fixed_max_size
+//   * runtime_max_size
+//   * normalization
+//   * db_frontier
+//   * memory_frontier
+//   * db_dedup
+//   * memory_dedup
+//   * no_dedup
+//   * no_canonicalization
+//   * crawl_policy
+//   * default_crawl_policy
+// ============================================================================
+
+
+#ifndef CRAWL_POLICY_H
+#define CRAWL_POLICY_H
+
+#include "uri.h"
+#include "database.h"
+#include "exceptions.h"
+
+#include <network/uri.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace crawler_pp {
+  namespace policies {
+
+    // ========================================================================
+    // === scheme policies ====================================================
+    // ========================================================================
+
+    // Accepts the schemes HTTP and HTTPS only. The check is a plain inline
+    // string comparison and needs no lookup in a container.
+    struct http_schemes {
+      static bool is_supported(const std::string &scheme){
+	return scheme == "http" || scheme == "https";
+      }
+    }; // end of struct http_schemes
+
+    // Accepts all schemes that are listed in
+    // crawler_pp::data::uri::SUPPORTED_SCHEMES.
+    struct runtime_schemes {
+      static bool is_supported(const std::string &scheme){
+	return std::find(crawler_pp::data::uri::SUPPORTED_SCHEMES.begin(),
+			 crawler_pp::data::uri::SUPPORTED_SCHEMES.end(),
+			 scheme) != crawler_pp::data::uri::SUPPORTED_SCHEMES.end();
+      }
+    }; // end of struct runtime_schemes
+
+    // ========================================================================
+    // === max size policies ==================================================
+    // ========================================================================
+
+    // Accepts all normalized URIs that are not longer than N characters.
+    template<size_t N>
+    struct fixed_max_size {
+      static constexpr size_t limit(){
+	return N;
+      }
+      static constexpr bool accepts(size_t size){
+	return size <= N;
+      }
+    }; // end of struct fixed_max_size
+
+    // Accepts all normalized URIs that are not longer than
+    // crawler_pp::data::uri::MAX_SIZE characters.
+    struct runtime_max_size {
+      static size_t limit(){
+	return crawler_pp::data::uri::MAX_SIZE;
+      }
+      static bool accepts(size_t size){
+	return size <= crawler_pp::data::uri::MAX_SIZE;
+      }
+    }; // end of struct runtime_max_size
+
+    // ========================================================================
+    // === normalization policies =============================================
+    // ========================================================================
+
+    // Normalizes an URI with the comparison level Level of cpp-netlib.
+    template<network::uri_comparison_level Level>
+    struct normalization {
+      static network::uri apply(const network::uri &uri){
+	return uri.normalize(Level);
+      }
+    }; // end of struct normalization
+
+    // ========================================================================
+    // === frontier backends ==================================================
+    // ========================================================================
+
+    // Pushes waiting uris to the DB, i.e. waiting_uri::persist is called
+    // directly without a virtual dispatch.
+    struct db_frontier {
+      bool push(crawler_pp::data::waiting_uri &&uri){
+	return uri.crawler_pp::data::waiting_uri::persist();
+      }
+      // Returns the number of uris that were added. All uris are queued
+      // before the first commit is awaited, so they share a group commit of
+      // the attached database.
+      size_t push(std::vector<crawler_pp::data::waiting_uri> &&uris){
+	std::shared_ptr<crawler_pp::data::database> db(crawler_pp::data::database::get_attached());
+	if(!db) throw crawler_pp::exceptions::db_exception("No database attached!");
+	std::vector<std::future<bool> > stored;
+	stored.reserve(uris.size());
+	for(size_t i(0); i != uris.size(); ++i) stored.push_back(db->persist(uris[i]));
+	size_t count(0);
+	for(size_t i(0); i != stored.size(); ++i)
+	  if(stored[i].get()) ++count;
+	return count;
+      }
+      bool has_next(){
+	return crawler_pp::data::waiting_uri::has_next();
+      }
+      crawler_pp::data::waiting_uri get_next(){
+	return crawler_pp::data::waiting_uri::get_next();
+      }
+    }; // end of struct db_frontier
+
+    // Keeps all waiting uris in memory in FIFO order. An uri that is already
+    // waiting is not pushed a second time. This backend is thread safe.
+    class memory_frontier {
+    public:
+      memory_frontier() = default;
+      memory_frontier(memory_frontier &&other)
+	:queue_(std::move(other.queue_)), waiting_(std::move(other.waiting_)) {}
+      // Returns true if the uri was added, false if it is already waiting.
+      bool push(crawler_pp::data::waiting_uri &&uri){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if(!this->waiting_.insert(uri.get_value()).second) return false;
+	this->queue_.push_back(std::move(uri));
+	return true;
+      }
+      // Pushes all uris while the frontier is locked once. Returns the number
+      // of uris that were added.
+      size_t push(std::vector<crawler_pp::data::waiting_uri> &&uris){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	size_t count(0);
+	for(size_t i(0); i != uris.size(); ++i) {
+	  if(!this->waiting_.insert(uris[i].get_value()).second) continue;
+	  this->queue_.push_back(std::move(uris[i]));
+	  ++count;
+	}
+	return count;
+      }
+      bool has_next(){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return !this->queue_.empty();
+      }
+      // Returns the oldest waiting uri. If no uri is waiting, the
+      // crawler_pp::exceptions::db_exception is thrown.
+      crawler_pp::data::waiting_uri get_next(){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if(this->queue_.empty())
+	  throw crawler_pp::exceptions::db_exception("No waiting uri available!");
+	crawler_pp::data::waiting_uri result(std::move(this->queue_.front()));
+	this->queue_.pop_front();
+	this->waiting_.erase(result.get_value());
+	return result;
+      }
+      size_t size(){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return this->queue_.size();
+      }
+    private:
+      std::mutex mutex_;
+      std::deque<crawler_pp::data::waiting_uri> queue_;
+      std::unordered_set<std::string> waiting_;
+    }; // end of class memory_frontier
+
+    // ========================================================================
+    // === dedup strategies ===================================================
+    // ========================================================================
+
+    // Checks and marks uris of type T (usually visited_uri) in the DB or, for
+    // visited_uri, in the attached visited_set. The passed strings must be
+    // normalized.
+    template<typename T>
+    struct db_dedup {
+      bool is_known(const std::string &uri){
+	return crawler_pp::data::uri::is_known<T>(T(uri, crawler_pp::data::uri::normalized_value()));
+      }
+      bool insert(const std::string &uri){
+	T tmp(uri, crawler_pp::data::uri::normalized_value());
+	return tmp.T::persist();
+      }
+    }; // end of struct db_dedup
+
+    // Keeps all known uris in memory. This strategy is thread safe.
+    class memory_dedup {
+    public:
+      memory_dedup() = default;
+      memory_dedup(memory_dedup &&other) :known_(std::move(other.known_)) {}
+      bool is_known(const std::string &uri){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return this->known_.count(uri) != 0;
+      }
+      // Returns true if the uri was not known before.
+      bool insert(const std::string &uri){
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return this->known_.insert(uri).second;
+      }
+    private:
+      std::mutex mutex_;
+      std::unordered_set<std::string> known_;
+    }; // end of class memory_dedup
+
+    // Treats every uri as unknown, i.e. no dedup is performed at all.
+    struct no_dedup {
+      bool is_known(const std::string&){
+	return false;
+      }
+      bool insert(const std::string&){
+	return true;
+      }
+    }; // end of struct no_dedup
+
+    // ========================================================================
+    // === canonicalizers =====================================================
+    // ========================================================================
+
+    // A canonicalizer rewrites normalized uris before they are checked by
+    // the dedup strategy (canonicalize), decides whether a new uri is pushed
+    // to the frontier (admit), hands out the uris it deferred before and
+    // admits now (release) and learns from the content fingerprints of
+    // fetched pages (observe), see crawler_pp::policies::url_analyzer.
+    // This canonicalizer keeps all uris unchanged and admits all of them.
+    struct no_canonicalization {
+      void canonicalize(std::string&){}
+      bool admit(const std::string&){
+	return true;
+      }
+      void release(std::vector<std::string>&){}
+      void observe(const std::string&, uint64_t){}
+    }; // end of struct no_canonicalization
+
+    // ========================================================================
+    // === crawl_policy =======================================================
+    // ========================================================================
+
+    // Bundles all policies of a crawl. The frontier backend, the dedup
+    // strategy and the canonicalizer are instantiated by crawl_frontend, all
+    // other policies are used by static calls only.
+    template<typename Schemes, typename MaxSize, typename Normalization,
+	     typename Frontier, typename Dedup, typename Canonicalizer = no_canonicalization>
+    struct crawl_policy {
+      typedef Schemes scheme_policy;
+      typedef MaxSize max_size_policy;
+      typedef Normalization normalization_policy;
+      typedef Frontier frontier_type;
+      typedef Dedup dedup_type;
+      typedef Canonicalizer canonicalizer_type;
+    }; // end of struct crawl_policy
+
+    // The policy that reflects the runtime configuration of the uri classes,
+    // i.e. crawler_pp::data::uri::SUPPORTED_SCHEMES and
+    // crawler_pp::data::uri::MAX_SIZE and the DB as frontier and dedup
+    // backend.
+    typedef crawl_policy<runtime_schemes,
+			 runtime_max_size,
+			 normalization<network::uri_comparison_level::syntax_based>,
+			 db_frontier,
+			 db_dedup<crawler_pp::data::visited_uri> > default_crawl_policy;
+  } // end of namespace policies
+} // end of namespace crawler_pp
+
+#endif // CRAWL_POLICY_H
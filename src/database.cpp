@@ -0,0 +1,325 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: database.cpp
+// Description: This implementation file implements the database class that
+//              pools the PostgreSQL connections and group commits the writes
+//              of all threads.
+// Public interfaces:
+//   * database_options
+//   * database_stats
+//   * database
+// ============================================================================
+
+
+#include "database.h"
+#include "exceptions.h"
+#include "odb/uri.odb.h"
+
+#include <odb/connection.hxx>
+#include <odb/exceptions.hxx>
+#include <odb/query.hxx>
+#include <odb/transaction.hxx>
+#include <odb/pgsql/connection-factory.hxx>
+#include <odb/pgsql/database.hxx>
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <unordered_set>
+#include <utility>
+
+using std::string;
+using crawler_pp::exceptions::db_exception;
+
+namespace {
+  // The database that is attached by database::attach
+  std::shared_ptr<crawler_pp::data::database> attached_database;
+
+  // The number of attempts of a transaction that fails by a deadlock or a
+  // serialization failure
+  const int MAX_ATTEMPTS(3);
+
+  // The names of the prepared queries of an uri type, the queries are
+  // prepared once per connection and cached by it
+  template<typename T> struct query_names;
+  template<> struct query_names<crawler_pp::data::waiting_uri> {
+    static const char* by_value(){
+      return "waiting_uri.by_value";
+    }
+  };
+  template<> struct query_names<crawler_pp::data::visited_uri> {
+    static const char* by_value(){
+      return "visited_uri.by_value";
+    }
+  };
+
+  // Returns the cached query of the passed connection that selects the uri
+  // of the type T with a value, the value is set by the passed parameter.
+  template<typename T>
+  odb::prepared_query<T> lookup_by_value(odb::connection &connection, string *&value){
+    odb::prepared_query<T> query(connection.lookup_query<T>(query_names<T>::by_value(), value));
+    if(!query) {
+      std::unique_ptr<string> parameter(new string());
+      value = parameter.get();
+      query = connection.prepare_query<T>(query_names<T>::by_value(),
+					  odb::query<T>::value == odb::query<T>::_ref(*value));
+      connection.cache_query(query, std::move(parameter));
+    }
+    return query;
+  }
+
+  // Returns the cached query of the passed connection that selects a single
+  // waiting uri. If lock is true the selected row is locked, rows that are
+  // locked by other transactions are skipped (PostgreSQL 9.5 or later). Only
+  // the row of the derived table is locked since the table of the
+  // polymorphic root is joined on the nullable side of an outer join.
+  odb::prepared_query<crawler_pp::data::waiting_uri> lookup_next(odb::connection &connection, bool lock){
+    const char *name(lock ? "waiting_uri.next" : "waiting_uri.any");
+    odb::prepared_query<crawler_pp::data::waiting_uri> query(connection.lookup_query<crawler_pp::data::waiting_uri>(name));
+    if(!query) {
+      query = connection.prepare_query<crawler_pp::data::waiting_uri>(name,
+	odb::query<crawler_pp::data::waiting_uri>(true) + (lock ? "LIMIT 1 FOR UPDATE OF waiting_uri SKIP LOCKED" : "LIMIT 1"));
+      connection.cache_query(query);
+    }
+    return query;
+  }
+} // end of anonymous namespace
+
+crawler_pp::data::database::database(const crawler_pp::data::database_options &options)
+  :options_(options), queued_(0), committed_(0), stopped_(false) {
+  this->options_.max_batch = std::max<size_t>(1, this->options_.max_batch);
+  try {
+    // The pool keeps all connections open, one for each worker and one for
+    // the commit thread
+    const size_t connections(std::max<size_t>(1, options.connections) + 1);
+    std::unique_ptr<odb::pgsql::connection_factory> pool(new odb::pgsql::connection_pool_factory(connections,
+												   connections));
+    this->db_.reset(new odb::pgsql::database(options.user, options.password, options.name, options.host,
+					     options.port, "", std::move(pool)));
+  } catch(const odb::exception &err) {
+    throw db_exception(err.what());
+  }
+  this->commit_thread_ = std::thread(&crawler_pp::data::database::commit_writes, this);
+}
+
+std::future<bool> crawler_pp::data::database::enqueue(bool visited, const string &value){
+  write_request request;
+  request.visited = visited;
+  request.value = value;
+  request.queued = std::chrono::steady_clock::now();
+  std::future<bool> result(request.stored.get_future());
+  bool notify;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if(this->stopped_) throw db_exception("The database is closed!");
+    // The commit thread is woken by the first write of a batch and when the
+    // batch is full
+    notify = this->queue_.empty() || this->queue_.size() + 1 >= this->options_.max_batch;
+    this->queue_.push_back(std::move(request));
+    ++this->queued_;
+  }
+  if(notify) this->queued_cv_.notify_one();
+  return result;
+}
+
+std::future<bool> crawler_pp::data::database::persist(const crawler_pp::data::waiting_uri &uri){
+  return this->enqueue(false, uri.get_value());
+}
+
+std::future<bool> crawler_pp::data::database::persist(const crawler_pp::data::visited_uri &uri){
+  return this->enqueue(true, uri.get_value());
+}
+
+template<typename T>
+bool crawler_pp::data::database::is_known(const string &value){
+  try {
+    odb::transaction transaction(this->db_->begin());
+    string *parameter(nullptr);
+    odb::prepared_query<T> query(lookup_by_value<T>(transaction.connection(), parameter));
+    *parameter = value;
+    const bool known(!query.execute().empty());
+    transaction.commit();
+    return known;
+  } catch(const odb::exception &err) {
+    throw db_exception(err.what());
+  }
+}
+
+template bool crawler_pp::data::database::is_known<crawler_pp::data::waiting_uri>(const string&);
+template bool crawler_pp::data::database::is_known<crawler_pp::data::visited_uri>(const string&);
+
+bool crawler_pp::data::database::get_next(crawler_pp::data::waiting_uri &uri){
+  for(int attempt(1); ; ++attempt) {
+    try {
+      odb::transaction transaction(this->db_->begin());
+      odb::result<waiting_uri> result(lookup_next(transaction.connection(), true).execute());
+      if(result.empty()) {
+	transaction.commit();
+	return false;
+      }
+      result.begin().load(uri);
+      this->db_->erase(uri);
+      transaction.commit();
+      return true;
+    } catch(const odb::recoverable &err) {
+      if(attempt == MAX_ATTEMPTS) throw db_exception(err.what());
+    } catch(const odb::exception &err) {
+      throw db_exception(err.what());
+    }
+  }
+}
+
+bool crawler_pp::data::database::has_next(){
+  try {
+    odb::transaction transaction(this->db_->begin());
+    const bool found(!lookup_next(transaction.connection(), false).execute().empty());
+    transaction.commit();
+    return found;
+  } catch(const odb::exception &err) {
+    throw db_exception(err.what());
+  }
+}
+
+void crawler_pp::data::database::commit_writes(){
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  while(true) {
+    this->queued_cv_.wait(lock, [this]{ return this->stopped_ || !this->queue_.empty(); });
+    if(this->queue_.empty()) break;
+    // The oldest write waits at most for the commit window, so the writes
+    // of other threads within this window share its transaction
+    const std::chrono::steady_clock::time_point deadline(this->queue_.front().queued + this->options_.commit_window);
+    this->queued_cv_.wait_until(lock, deadline, [this]{
+	return this->stopped_ || this->queue_.size() >= this->options_.max_batch;
+      });
+    std::vector<write_request> batch;
+    if(this->queue_.size() <= this->options_.max_batch) {
+      batch.swap(this->queue_);
+    } else {
+      batch.assign(std::make_move_iterator(this->queue_.begin()),
+		   std::make_move_iterator(this->queue_.begin() + this->options_.max_batch));
+      this->queue_.erase(this->queue_.begin(), this->queue_.begin() + this->options_.max_batch);
+    }
+    lock.unlock();
+    this->commit(batch);
+    lock.lock();
+    this->committed_ += batch.size();
+    this->committed_cv_.notify_all();
+  }
+}
+
+void crawler_pp::data::database::insert(std::vector<write_request> &batch, size_t begin, size_t end,
+					std::vector<bool> &stored){
+  for(int attempt(1); ; ++attempt) {
+    try {
+      odb::transaction transaction(this->db_->begin());
+      // A single query finds the values that are stored already
+      std::unordered_set<string> values;
+      for(size_t i(begin); i != end; ++i) values.insert(batch[i].value);
+      odb::result<uri> existing(this->db_->query<uri>(odb::query<uri>::value.in_range(values.begin(),
+											values.end())));
+      for(odb::result<uri>::iterator it(existing.begin()); it != existing.end(); ++it) values.erase(it.id());
+      // A value that is queued twice is stored by its first write
+      for(size_t i(begin); i != end; ++i) {
+	stored[i] = values.erase(batch[i].value) != 0;
+	if(!stored[i]) continue;
+	if(batch[i].visited) {
+	  const visited_uri value(batch[i].value, uri::normalized_value());
+	  this->db_->persist(value);
+	} else {
+	  const waiting_uri value(batch[i].value, uri::normalized_value());
+	  this->db_->persist(value);
+	}
+      }
+      transaction.commit();
+      return;
+    } catch(const odb::object_already_persistent &err) {
+      // A concurrent writer stored a value after the query, the next attempt
+      // finds it
+      if(attempt == MAX_ATTEMPTS) throw db_exception(err.what());
+    } catch(const odb::recoverable &err) {
+      if(attempt == MAX_ATTEMPTS) throw db_exception(err.what());
+    } catch(const odb::exception &err) {
+      throw db_exception(err.what());
+    }
+  }
+}
+
+void crawler_pp::data::database::commit(std::vector<write_request> &batch){
+  std::vector<bool> stored(batch.size(), false);
+  std::vector<std::exception_ptr> errors(batch.size());
+  uint64_t transactions(0);
+  try {
+    this->insert(batch, 0, batch.size(), stored);
+    ++transactions;
+  } catch(const db_exception&) {
+    if(batch.size() == 1) {
+      errors[0] = std::current_exception();
+    } else {
+      // Each write is retried by its own transaction, so only the writes that
+      // fail by themselves (e.g. a too long value) receive the error
+      for(size_t i(0); i != batch.size(); ++i) {
+	try {
+	  this->insert(batch, i, i + 1, stored);
+	  ++transactions;
+	} catch(const db_exception&) {
+	  errors[i] = std::current_exception();
+	}
+      }
+    }
+  }
+
+  const std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stats_.transactions += transactions;
+    for(size_t i(0); i != batch.size(); ++i) {
+      if(errors[i]) continue;
+      ++this->stats_.writes;
+      const std::chrono::duration<double> latency(now - batch[i].queued);
+      this->stats_.total_latency += latency;
+      this->stats_.max_latency = std::max(this->stats_.max_latency, latency);
+    }
+  }
+  for(size_t i(0); i != batch.size(); ++i) {
+    if(errors[i]) batch[i].stored.set_exception(errors[i]);
+    else batch[i].stored.set_value(stored[i]);
+  }
+}
+
+void crawler_pp::data::database::flush(){
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  const uint64_t target(this->queued_);
+  this->committed_cv_.wait(lock, [this, target]{ return this->committed_ >= target; });
+}
+
+crawler_pp::data::database_stats crawler_pp::data::database::get_stats(){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->stats_;
+}
+
+void crawler_pp::data::database::attach(std::shared_ptr<crawler_pp::data::database> db){
+  std::atomic_store(&attached_database, db);
+}
+
+std::shared_ptr<crawler_pp::data::database> crawler_pp::data::database::get_attached(){
+  return std::atomic_load(&attached_database);
+}
+
+crawler_pp::data::database::~database(){
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stopped_ = true;
+  }
+  // The commit thread commits all queued writes before it stops
+  this->queued_cv_.notify_all();
+  if(this->commit_thread_.joinable()) this->commit_thread_.join();
+}
+
+std::ostream& crawler_pp::data::operator<<(std::ostream &os, const crawler_pp::data::database_stats &stats){
+  os << "transactions: " << stats.transactions << "\n"
+     << "writes: " << stats.writes << "\n"
+     << "writes/transaction: " << (stats.transactions ? double(stats.writes) / stats.transactions : 0) << "\n"
+     << "average commit latency (ms): " << stats.average_latency().count() * 1000 << "\n"
+     << "max commit latency (ms): " << stats.max_latency.count() * 1000 << "\n";
+  return os;
+}
@@ -0,0 +1,157 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: database.h
+// Description: This header file defines the database class, the shared
+//              PostgreSQL handle of crawler_pp. It owns an ODB connection
+//              pool that is sized to the number of worker threads, caches
+//              the prepared queries of the uri lookups per connection and
+//              group commits the writes of all threads, i.e. the uris that
+//              are persisted within a short window are inserted by a single
+//              transaction.
+// Public interfaces:
+//   * database_options
+//   * database_stats
+//   * database
+// ============================================================================
+
+
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include "uri.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace odb {
+  namespace pgsql {
+    class database;
+  } // end of namespace pgsql
+} // end of namespace odb
+
+namespace crawler_pp {
+  namespace data {
+
+    // Bundles all parameters of a database.
+    struct database_options {
+      // The connection parameters, see odb::pgsql::database
+      std::string user;
+      std::string password;
+      std::string name;
+      std::string host;
+      unsigned port = 0;
+      // The number of worker threads that access the database concurrently,
+      // the pool holds one more connection for the commit thread
+      size_t connections = 4;
+      // The time a write waits for further writes before they are committed
+      std::chrono::microseconds commit_window = std::chrono::microseconds(2000);
+      // The maximum number of writes per transaction, a full batch is
+      // committed immediately
+      size_t max_batch = 1024;
+    }; // end of struct database_options
+
+    // The counters of a database
+    struct database_stats {
+      // The group commits, i.e. transactions of the commit thread
+      uint64_t transactions = 0;
+      // The writes that were committed
+      uint64_t writes = 0;
+      // The sum and the maximum of the times from queueing a write until
+      // its transaction was committed
+      std::chrono::duration<double> total_latency = std::chrono::duration<double>(0);
+      std::chrono::duration<double> max_latency = std::chrono::duration<double>(0);
+      // Returns the average time from queueing a write until its commit.
+      std::chrono::duration<double> average_latency() const {
+	return this->writes ? this->total_latency / static_cast<double>(this->writes) :
+	  std::chrono::duration<double>(0);
+      }
+    }; // end of struct database_stats
+
+    // Writes the passed database_stats to the given ostream.
+    std::ostream& operator<<(std::ostream&, const database_stats&);
+
+    // This class wraps all DB operations of the uri classes. Reads run on a
+    // pooled connection of the calling thread, writes are queued and
+    // committed by a dedicated thread. All methods are thread safe, all DB
+    // errors are thrown as crawler_pp::exceptions::db_exception.
+    class database {
+    public:
+      // This constructor connects to the database and starts the commit
+      // thread. The schema (see odb/uri.sql) must exist.
+      database(const database_options&);
+      // A database cannot be copied, since it owns the connections.
+      database(const database&) = delete;
+      database& operator=(const database&) = delete;
+      // Queues the passed uri for the next group commit. The future is true
+      // if the uri was stored and false if the same uri already existed.
+      std::future<bool> persist(const waiting_uri&);
+      std::future<bool> persist(const visited_uri&);
+      // Returns true if an uri of the type T with the passed normalized value
+      // is stored. Only waiting_uri and visited_uri are supported.
+      template<typename T> bool is_known(const std::string&);
+      // Removes the next waiting uri from the DB and stores it in the passed
+      // waiting_uri. Concurrent callers receive different uris. Returns false
+      // if no waiting uri exists.
+      bool get_next(waiting_uri&);
+      // Returns true if a waiting uri exists.
+      bool has_next();
+      // Blocks until all queued writes are committed.
+      void flush();
+      // Returns the current counters.
+      database_stats get_stats();
+      // Makes the passed database the backend of the persist and lookup
+      // methods of the uri classes. Passing nullptr detaches the current
+      // database.
+      static void attach(std::shared_ptr<database>);
+      // Returns the attached database or nullptr if none is attached.
+      static std::shared_ptr<database> get_attached();
+      // The destructor commits all queued writes and stops the commit
+      // thread.
+      ~database();
+    private:
+      // A queued write
+      struct write_request {
+	bool visited;
+	std::string value;
+	std::chrono::steady_clock::time_point queued;
+	std::promise<bool> stored;
+      };
+
+      // Queues the passed write and returns its future.
+      std::future<bool> enqueue(bool, const std::string&);
+      // The function of the commit thread
+      void commit_writes();
+      // Inserts the passed range of writes that are not stored yet by a
+      // single transaction and sets their flags stored. If the transaction
+      // fails the crawler_pp::exceptions::db_exception is thrown.
+      void insert(std::vector<write_request>&, size_t, size_t, std::vector<bool>&);
+      // Inserts the passed writes by a single transaction, or by a
+      // transaction per write if it fails, and fulfills their promises.
+      void commit(std::vector<write_request>&);
+
+      database_options options_;
+      std::unique_ptr<odb::pgsql::database> db_;
+      // Guards all following members
+      std::mutex mutex_;
+      std::condition_variable queued_cv_;
+      std::condition_variable committed_cv_;
+      std::vector<write_request> queue_;
+      // The number of writes that were queued and committed (or failed)
+      uint64_t queued_;
+      uint64_t committed_;
+      database_stats stats_;
+      bool stopped_;
+      std::thread commit_thread_;
+    }; // end of class database
+  } // end of namespace data
+} // end of namespace crawler_pp
+
+#endif // DATABASE_H
@@ -0,0 +1,148 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: db_benchmark.cpp
+// Description: This file contains a command line tool that persists waiting
+//              uris from a growing number of threads to a PostgreSQL
+//              database and prints the transactions per second and the
+//              commit latency of the group commit and, for comparison, of a
+//              transaction per write that each thread runs directly on its
+//              pooled connection.
+// Public interfaces:
+//   * int main(int, char**)
+// ============================================================================
+
+#include "database.h"
+#include "exceptions.h"
+#include "uri.h"
+#include "odb/uri.odb.h"
+
+#include <odb/exceptions.hxx>
+#include <odb/transaction.hxx>
+#include <odb/pgsql/connection-factory.hxx>
+#include <odb/pgsql/database.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+  // Prints a single result line.
+  void print(const char *commit, size_t threads, const crawler_pp::data::database_stats &stats,
+	     const std::chrono::duration<double> &elapsed){
+    cout << commit << "\t" << threads << "\t"
+	 << stats.transactions / elapsed.count() << "\t"
+	 << stats.writes / elapsed.count() << "\t"
+	 << stats.average_latency().count() * 1000 << "\t"
+	 << stats.max_latency.count() * 1000 << endl;
+  }
+
+  // Returns the prefix of the uris of a single run.
+  string get_prefix(const char *commit, size_t threads){
+    return "http://www.sueddeutsche.de/benchmark/" + std::to_string(std::time(nullptr)) + "/" + commit + "/" +
+      std::to_string(threads) + "/";
+  }
+
+  // Persists writes waiting uris from each of the passed number of threads
+  // by the group commit of crawler_pp::data::database.
+  void run_group(const crawler_pp::data::database_options &defaults, size_t threads, size_t writes){
+    crawler_pp::data::database_options options(defaults);
+    options.connections = threads;
+    crawler_pp::data::database db(options);
+    const string prefix(get_prefix("group", threads));
+
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    std::vector<std::thread> workers;
+    for(size_t i(0); i != threads; ++i)
+      workers.push_back(std::thread([&db, &prefix, i, writes](){
+	    // Each worker waits for its write like a crawl thread does
+	    for(size_t j(0); j != writes; ++j)
+	      db.persist(crawler_pp::data::waiting_uri(prefix + std::to_string(i * writes + j),
+						       crawler_pp::data::uri::normalized_value())).get();
+	  }));
+    for(size_t i(0); i != workers.size(); ++i) workers[i].join();
+    const std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start);
+    print("group ", threads, db.get_stats(), elapsed);
+  }
+
+  // Persists writes waiting uris from each of the passed number of threads,
+  // each write is committed by its own transaction on the pooled connection
+  // of its thread.
+  void run_single(const crawler_pp::data::database_options &options, size_t threads, size_t writes){
+    std::unique_ptr<odb::pgsql::connection_factory> pool(new odb::pgsql::connection_pool_factory(threads, threads));
+    odb::pgsql::database db(options.user, options.password, options.name, options.host, options.port, "",
+			    std::move(pool));
+    const string prefix(get_prefix("single", threads));
+    std::mutex mutex;
+    crawler_pp::data::database_stats stats;
+    bool failed(false);
+
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    std::vector<std::thread> workers;
+    for(size_t i(0); i != threads; ++i)
+      workers.push_back(std::thread([&db, &prefix, &mutex, &stats, &failed, i, writes](){
+	    try {
+	      for(size_t j(0); j != writes; ++j) {
+		const std::chrono::steady_clock::time_point queued(std::chrono::steady_clock::now());
+		odb::transaction transaction(db.begin());
+		db.persist(crawler_pp::data::waiting_uri(prefix + std::to_string(i * writes + j),
+							 crawler_pp::data::uri::normalized_value()));
+		transaction.commit();
+		const std::chrono::duration<double> latency(std::chrono::steady_clock::now() - queued);
+		std::lock_guard<std::mutex> lock(mutex);
+		++stats.transactions;
+		++stats.writes;
+		stats.total_latency += latency;
+		stats.max_latency = std::max(stats.max_latency, latency);
+	      }
+	    } catch(const odb::exception &err) {
+	      std::lock_guard<std::mutex> lock(mutex);
+	      if(!failed) cerr << err.what() << endl;
+	      failed = true;
+	    }
+	  }));
+    for(size_t i(0); i != workers.size(); ++i) workers[i].join();
+    const std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start);
+    if(failed) throw crawler_pp::exceptions::db_exception("A transaction of the single commit failed!");
+    print("single", threads, stats, elapsed);
+  }
+} // end of anonymous namespace
+
+int main(int argc, char **argv){
+  if(argc < 2) {
+    cerr << "usage: " << argv[0] << " <db name> [user] [password] [host] [max threads] [writes per thread]" << endl
+	 << "The database must contain the schema of odb/uri.sql." << endl;
+    return 1;
+  }
+
+  crawler_pp::data::database_options options;
+  options.name = argv[1];
+  if(argc > 2) options.user = argv[2];
+  if(argc > 3) options.password = argv[3];
+  if(argc > 4) options.host = argv[4];
+  const size_t max_threads(argc > 5 ? std::strtoul(argv[5], nullptr, 10) : 32);
+  const size_t writes(argc > 6 ? std::strtoul(argv[6], nullptr, 10) : 1000);
+
+  cout << "commit\tthreads\ttx/sec\twrites/sec\tavg latency (ms)\tmax latency (ms)" << endl;
+  try {
+    for(size_t threads(1); threads <= max_threads; threads *= 2) {
+      run_single(options, threads, writes);
+      run_group(options, threads, writes);
+    }
+  } catch(crawler_pp::exceptions::db_exception &err) {
+    cerr << err << endl;
+    return 1;
+  }
+  return 0;
+}
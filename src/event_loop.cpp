@@ -0,0 +1,212 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: event_loop.cpp
+// Description: This implementation file implements the event loop, the pool
+//              of event loops and the asynchronous semaphore of the crawl
+//              pipeline. This file requires C++20.
+// Public interfaces:
+//   * event_loop
+//   * loop_pool
+//   * async_semaphore
+// ============================================================================
+
+
+#include "event_loop.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+  // The loop that runs on the current thread
+  thread_local crawler_pp::async::event_loop *current_loop(nullptr);
+} // end of anonymous namespace
+
+// ============================================================================
+// === the event_loop class ===================================================
+// ============================================================================
+
+crawler_pp::async::event_loop::event_loop() :epoll_fd_(-1), event_fd_(-1), stopped_(false) {
+  this->epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if(this->epoll_fd_ < 0) throw std::system_error(errno, std::system_category(), "epoll_create1");
+  this->event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(this->event_fd_ < 0) {
+    close(this->epoll_fd_);
+    throw std::system_error(errno, std::system_category(), "eventfd");
+  }
+  // The event fd is marked by a null pointer
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  epoll_ctl(this->epoll_fd_, EPOLL_CTL_ADD, this->event_fd_, &event);
+}
+
+crawler_pp::async::event_loop* crawler_pp::async::event_loop::current(){
+  return current_loop;
+}
+
+void crawler_pp::async::event_loop::post(std::coroutine_handle<> handle){
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    wake = this->posted_.empty();
+    this->posted_.push_back(handle);
+  }
+  // The loop is woken once per batch of posted coroutines
+  if(wake) {
+    const uint64_t one(1);
+    if(write(this->event_fd_, &one, sizeof(one)) < 0) {}
+  }
+}
+
+void crawler_pp::async::event_loop::stop(){
+  this->stopped_.store(true);
+  const uint64_t one(1);
+  if(write(this->event_fd_, &one, sizeof(one)) < 0) {}
+}
+
+bool crawler_pp::async::event_loop::add_waiter(const std::shared_ptr<waiter> &target,
+					       clock::time_point deadline){
+  if(target->fd >= 0) {
+    // A socket is registered once and re-armed for each wait
+    epoll_event event{};
+    event.events = target->events | EPOLLONESHOT;
+    event.data.ptr = target.get();
+    if(epoll_ctl(this->epoll_fd_, EPOLL_CTL_MOD, target->fd, &event) &&
+       (errno != ENOENT || epoll_ctl(this->epoll_fd_, EPOLL_CTL_ADD, target->fd, &event))) {
+      target->events = EPOLLERR;
+      return false;
+    }
+  }
+  if(deadline != clock::time_point::max()) {
+    target->timer = this->timers_.insert(std::make_pair(deadline, target));
+    target->timed = true;
+  }
+  return true;
+}
+
+void crawler_pp::async::event_loop::run_posted(){
+  std::vector<std::coroutine_handle<> > posted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    posted.swap(this->posted_);
+  }
+  for(size_t i(0); i != posted.size(); ++i) posted[i].resume();
+}
+
+void crawler_pp::async::event_loop::run(){
+  current_loop = this;
+  std::vector<epoll_event> events(256);
+  while(!this->stopped_.load()) {
+    int timeout(-1);
+    if(!this->timers_.empty()) {
+      const clock::duration left(this->timers_.begin()->first - clock::now());
+      timeout = left.count() <= 0 ? 0 :
+	static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(std::min(left, clock::duration(std::chrono::seconds(60)))).count());
+    }
+    const int count(epoll_wait(this->epoll_fd_, events.data(), static_cast<int>(events.size()), timeout));
+    if(count < 0 && errno != EINTR) throw std::system_error(errno, std::system_category(), "epoll_wait");
+    for(int i(0); i < count; ++i) {
+      waiter *target(static_cast<waiter*>(events[i].data.ptr));
+      if(!target) {
+	uint64_t value;
+	if(read(this->event_fd_, &value, sizeof(value)) < 0) {}
+	continue;
+      }
+      // A waiter whose timer expired is unregistered, so it is still alive
+      if(target->done) continue;
+      target->done = true;
+      target->events = events[i].events;
+      if(target->timed) {
+	target->timed = false;
+	this->timers_.erase(target->timer);
+      }
+      target->handle.resume();
+    }
+    const clock::time_point now(clock::now());
+    while(!this->timers_.empty() && this->timers_.begin()->first <= now) {
+      const std::shared_ptr<waiter> target(this->timers_.begin()->second);
+      this->timers_.erase(this->timers_.begin());
+      target->timed = false;
+      target->done = true;
+      target->events = 0;
+      if(target->fd >= 0) epoll_ctl(this->epoll_fd_, EPOLL_CTL_DEL, target->fd, nullptr);
+      target->handle.resume();
+    }
+    this->run_posted();
+  }
+  current_loop = nullptr;
+}
+
+crawler_pp::async::event_loop::~event_loop(){
+  close(this->event_fd_);
+  close(this->epoll_fd_);
+}
+
+// ============================================================================
+// === the loop_pool class ====================================================
+// ============================================================================
+
+crawler_pp::async::loop_pool::loop_pool(unsigned count) :next_(0) {
+  if(!count) count = 1;
+  for(unsigned i(0); i != count; ++i) this->loops_.push_back(std::unique_ptr<event_loop>(new event_loop()));
+  for(unsigned i(0); i != count; ++i)
+    this->threads_.push_back(std::thread(&crawler_pp::async::event_loop::run, this->loops_[i].get()));
+}
+
+crawler_pp::async::event_loop& crawler_pp::async::loop_pool::next(){
+  return *this->loops_[this->next_.fetch_add(1) % this->loops_.size()];
+}
+
+size_t crawler_pp::async::loop_pool::size() const {
+  return this->loops_.size();
+}
+
+void crawler_pp::async::loop_pool::stop(){
+  for(size_t i(0); i != this->loops_.size(); ++i) this->loops_[i]->stop();
+  for(size_t i(0); i != this->threads_.size(); ++i)
+    if(this->threads_[i].joinable()) this->threads_[i].join();
+}
+
+crawler_pp::async::loop_pool::~loop_pool(){
+  this->stop();
+}
+
+// ============================================================================
+// === the async_semaphore class ==============================================
+// ============================================================================
+
+crawler_pp::async::async_semaphore::async_semaphore(size_t count) :count_(count) {}
+
+bool crawler_pp::async::async_semaphore::suspend(std::coroutine_handle<> handle){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if(this->count_) {
+    --this->count_;
+    return false;
+  }
+  this->waiting_.push_back(std::make_pair(handle, event_loop::current()));
+  return true;
+}
+
+void crawler_pp::async::async_semaphore::release(){
+  std::pair<std::coroutine_handle<>, event_loop*> next;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if(this->waiting_.empty()) {
+      ++this->count_;
+      return;
+    }
+    // The permit is passed to the oldest waiting coroutine
+    next = this->waiting_.front();
+    this->waiting_.pop_front();
+  }
+  next.second->post(next.first);
+}
+
+size_t crawler_pp::async::async_semaphore::available(){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->count_;
+}
@@ -0,0 +1,352 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: event_loop.h
+// Description: This header file defines the building blocks of the crawl
+//              pipeline that runs fetches as C++20 coroutines: a lazy task
+//              type, an epoll based event loop that resumes coroutines when
+//              a socket is ready or a timer expires, a pool of event loops
+//              and an asynchronous semaphore that bounds the number of
+//              coroutines in a stage. This header requires C++20.
+// Public interfaces:
+//   * task
+//   * spawn
+//   * event_loop
+//   * loop_pool
+//   * async_semaphore
+// ============================================================================
+
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace crawler_pp {
+  namespace async {
+
+    template<typename T = void> class task;
+
+    namespace detail {
+      // The parts of a task promise that do not depend on the result type.
+      // At the end of the coroutine the awaiting coroutine is resumed by a
+      // symmetric transfer, so a chain of tasks does not grow the stack.
+      struct promise_base {
+	struct final_awaiter {
+	  bool await_ready() noexcept {
+	    return false;
+	  }
+	  template<typename Promise>
+	  std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+	    std::coroutine_handle<> continuation(handle.promise().continuation);
+	    return continuation ? continuation : std::noop_coroutine();
+	  }
+	  void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept {
+	  return {};
+	}
+	final_awaiter final_suspend() noexcept {
+	  return {};
+	}
+	void unhandled_exception() noexcept {
+	  this->error = std::current_exception();
+	}
+
+	std::coroutine_handle<> continuation;
+	std::exception_ptr error;
+      }; // end of struct promise_base
+
+      template<typename T>
+      struct promise : promise_base {
+	task<T> get_return_object() noexcept;
+	void return_value(T value){
+	  this->value.emplace(std::move(value));
+	}
+
+	std::optional<T> value;
+      }; // end of struct promise
+
+      template<>
+      struct promise<void> : promise_base {
+	task<void> get_return_object() noexcept;
+	void return_void() noexcept {}
+      }; // end of struct promise<void>
+    } // end of namespace detail
+
+    // A coroutine that is started when it is awaited and returns a value of
+    // type T to the awaiting coroutine. An exception that leaves the
+    // coroutine is rethrown by co_await.
+    template<typename T>
+    class task {
+    public:
+      typedef detail::promise<T> promise_type;
+
+      explicit task(std::coroutine_handle<promise_type> handle) noexcept :handle_(handle) {}
+      task(task &&other) noexcept :handle_(std::exchange(other.handle_, nullptr)) {}
+      task& operator=(task &&other) noexcept {
+	if(this != &other) {
+	  if(this->handle_) this->handle_.destroy();
+	  this->handle_ = std::exchange(other.handle_, nullptr);
+	}
+	return *this;
+      }
+      task(const task&) = delete;
+      task& operator=(const task&) = delete;
+      bool await_ready() const noexcept {
+	return false;
+      }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+	this->handle_.promise().continuation = continuation;
+	return this->handle_;
+      }
+      T await_resume(){
+	promise_type &promise(this->handle_.promise());
+	if(promise.error) std::rethrow_exception(promise.error);
+	if constexpr(!std::is_void<T>::value) return std::move(*promise.value);
+      }
+      // The destructor destroys the coroutine frame.
+      ~task(){
+	if(this->handle_) this->handle_.destroy();
+      }
+    private:
+      std::coroutine_handle<promise_type> handle_;
+    }; // end of class task
+
+    template<typename T>
+    task<T> detail::promise<T>::get_return_object() noexcept {
+      return task<T>(std::coroutine_handle<promise<T> >::from_promise(*this));
+    }
+
+    inline task<void> detail::promise<void>::get_return_object() noexcept {
+      return task<void>(std::coroutine_handle<promise<void> >::from_promise(*this));
+    }
+
+    namespace detail {
+      // A coroutine that starts immediately and destroys itself at its end.
+      struct detached {
+	struct promise_type {
+	  detached get_return_object() noexcept {
+	    return {};
+	  }
+	  std::suspend_never initial_suspend() noexcept {
+	    return {};
+	  }
+	  std::suspend_never final_suspend() noexcept {
+	    return {};
+	  }
+	  void return_void() noexcept {}
+	  void unhandled_exception() noexcept {
+	    std::terminate();
+	  }
+	};
+      }; // end of struct detached
+
+      inline detached run_detached(task<void> work){
+	co_await work;
+      }
+    } // end of namespace detail
+
+    // Runs the passed task on the calling thread until it suspends the first
+    // time, the task is destroyed at its end. The task must handle all of
+    // its exceptions, otherwise std::terminate is called.
+    inline void spawn(task<void> &&work){
+      detail::run_detached(std::move(work));
+    }
+
+    // This class resumes coroutines on a single thread: coroutines that are
+    // posted by any thread, coroutines that wait for a socket and
+    // coroutines that wait for a timer. The awaitables sleep_until,
+    // sleep_for and wait must be awaited on the thread of the loop.
+    class event_loop {
+    public:
+      typedef std::chrono::steady_clock clock;
+    private:
+      struct waiter;
+      // The waiters with a deadline ordered by their deadline
+      typedef std::multimap<clock::time_point, std::shared_ptr<waiter> > timer_map;
+
+      // A suspended coroutine that waits for a socket or a timer
+      struct waiter {
+	std::coroutine_handle<> handle;
+	int fd;
+	uint32_t events;
+	bool done;
+	// The entry in timers_, it is removed as soon as the socket is ready,
+	// so a finished wait does not keep its waiter alive until the deadline
+	timer_map::iterator timer;
+	bool timed;
+      };
+    public:
+      // The awaitable of sleep_until, sleep_for and wait. co_await returns
+      // the epoll events of the socket or 0 if the deadline was reached.
+      class wait_awaiter {
+      public:
+	wait_awaiter(event_loop &loop, int fd, uint32_t events, clock::time_point deadline)
+	  :loop_(loop), waiter_(std::make_shared<waiter>()), deadline_(deadline) {
+	  this->waiter_->fd = fd;
+	  this->waiter_->events = events;
+	  this->waiter_->done = false;
+	  this->waiter_->timed = false;
+	}
+	bool await_ready() const noexcept {
+	  return false;
+	}
+	bool await_suspend(std::coroutine_handle<> handle){
+	  this->waiter_->handle = handle;
+	  return this->loop_.add_waiter(this->waiter_, this->deadline_);
+	}
+	uint32_t await_resume() const noexcept {
+	  return this->waiter_->events;
+	}
+      private:
+	event_loop &loop_;
+	std::shared_ptr<waiter> waiter_;
+	clock::time_point deadline_;
+      }; // end of class wait_awaiter
+
+      // The awaitable of schedule
+      struct schedule_awaiter {
+	bool await_ready() const noexcept {
+	  return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle){
+	  this->loop.post(handle);
+	}
+	void await_resume() const noexcept {}
+
+	event_loop &loop;
+      }; // end of struct schedule_awaiter
+
+      // This constructor creates the epoll instance of the loop. If it cannot
+      // be created the std::system_error is thrown.
+      event_loop();
+      // An event_loop cannot be copied, since it owns file descriptors.
+      event_loop(const event_loop&) = delete;
+      event_loop& operator=(const event_loop&) = delete;
+      // Runs the loop on the calling thread until stop is called.
+      void run();
+      // Makes run return, this method is thread safe.
+      void stop();
+      // Resumes the passed coroutine on the thread of the loop, this method
+      // is thread safe.
+      void post(std::coroutine_handle<>);
+      // Returns the loop that runs on the calling thread or nullptr.
+      static event_loop* current();
+      // Returns an awaitable that continues the awaiting coroutine on the
+      // thread of this loop.
+      schedule_awaiter schedule(){
+	return schedule_awaiter{*this};
+      }
+      // Returns an awaitable that resumes the awaiting coroutine at the
+      // passed time.
+      wait_awaiter sleep_until(clock::time_point deadline){
+	return wait_awaiter(*this, -1, 0, deadline);
+      }
+      // Returns an awaitable that resumes the awaiting coroutine after the
+      // passed duration.
+      wait_awaiter sleep_for(clock::duration duration){
+	return wait_awaiter(*this, -1, 0, clock::now() + duration);
+      }
+      // Returns an awaitable that resumes the awaiting coroutine as soon as
+      // the passed non-blocking socket has one of the passed epoll events
+      // (e.g. EPOLLIN) or the passed deadline is reached.
+      wait_awaiter wait(int fd, uint32_t events, clock::time_point deadline = clock::time_point::max()){
+	return wait_awaiter(*this, fd, events, deadline);
+      }
+      // The destructor closes the file descriptors of the loop.
+      ~event_loop();
+    private:
+      // Registers the passed waiter, returns false if the awaiting coroutine
+      // is not suspended since the socket cannot be watched.
+      bool add_waiter(const std::shared_ptr<waiter>&, clock::time_point);
+      // Resumes the posted coroutines.
+      void run_posted();
+
+      int epoll_fd_;
+      int event_fd_;
+      std::atomic<bool> stopped_;
+      std::mutex mutex_;
+      std::vector<std::coroutine_handle<> > posted_;
+      timer_map timers_;
+    }; // end of class event_loop
+
+    // This class runs a fixed number of event loops, each on its own
+    // thread.
+    class loop_pool {
+    public:
+      // This constructor starts the passed number of loops.
+      explicit loop_pool(unsigned);
+      loop_pool(const loop_pool&) = delete;
+      loop_pool& operator=(const loop_pool&) = delete;
+      // Returns the loops one after the other, this method is thread safe.
+      event_loop& next();
+      // Returns the number of loops.
+      size_t size() const;
+      // Stops all loops and joins their threads.
+      void stop();
+      // The destructor stops all loops.
+      ~loop_pool();
+    private:
+      std::vector<std::unique_ptr<event_loop> > loops_;
+      std::vector<std::thread> threads_;
+      std::atomic<size_t> next_;
+    }; // end of class loop_pool
+
+    // A counting semaphore for coroutines: acquire suspends the awaiting
+    // coroutine while no permit is available, release resumes the oldest
+    // waiting coroutine on its own event loop. This class is thread safe.
+    class async_semaphore {
+    public:
+      // The awaitable of acquire
+      struct acquire_awaiter {
+	bool await_ready() const noexcept {
+	  return false;
+	}
+	bool await_suspend(std::coroutine_handle<> handle){
+	  return this->semaphore.suspend(handle);
+	}
+	void await_resume() const noexcept {}
+
+	async_semaphore &semaphore;
+      }; // end of struct acquire_awaiter
+
+      // This constructor takes the number of permits.
+      explicit async_semaphore(size_t);
+      async_semaphore(const async_semaphore&) = delete;
+      async_semaphore& operator=(const async_semaphore&) = delete;
+      // Returns an awaitable that takes a permit. It must be awaited on the
+      // thread of an event loop.
+      acquire_awaiter acquire(){
+	return acquire_awaiter{*this};
+      }
+      // Returns a permit.
+      void release();
+      // Returns the number of available permits.
+      size_t available();
+    private:
+      // Takes a permit or queues the passed coroutine, returns true if the
+      // coroutine must be suspended.
+      bool suspend(std::coroutine_handle<>);
+
+      std::mutex mutex_;
+      size_t count_;
+      std::deque<std::pair<std::coroutine_handle<>, event_loop*> > waiting_;
+    }; // end of class async_semaphore
+  } // end of namespace async
+} // end of namespace crawler_pp
+
+#endif // EVENT_LOOP_H
@@ -7,6 +7,8 @@
 //   *exception
 //   *uri_exception
 //   *db_exception
+//   *warc_exception
+//   *sitemap_exception
 //   *not_implemented_exception
 // ============================================================================
 
@@ -24,7 +26,7 @@ std::string crawler_pp::exceptions::exception::get_message() const {
 }
 
 const char* crawler_pp::exceptions::exception::what() const throw(){
-  return this->get_message().c_str();
+  return this->message_.c_str();
 }
 
 std::ostream& crawler_pp::exceptions::operator<<(std::ostream &os,
@@ -58,6 +60,40 @@ crawler_pp::exceptions::db_exception::db_exception(const std::string &message)
 
 crawler_pp::exceptions::db_exception::~db_exception() throw() {}
 
+// === class warc_exception ===================================================
+crawler_pp::exceptions::warc_exception::warc_exception(const std::string &message,
+							const std::string &path)
+  :exception(message), path_(path) { }
+
+std::string crawler_pp::exceptions::warc_exception::get_path() const {
+  return this->path_;
+}
+
+std::ostream& crawler_pp::exceptions::operator<<(std::ostream &os,
+						  const crawler_pp::exceptions::warc_exception &err){
+  os << err.get_message() << " (warc file: " << err.get_path() << ")";
+  return os;
+}
+
+crawler_pp::exceptions::warc_exception::~warc_exception() throw() {}
+
+// === class sitemap_exception ================================================
+crawler_pp::exceptions::sitemap_exception::sitemap_exception(const std::string &message,
+							      const std::string &path)
+  :exception(message), path_(path) { }
+
+std::string crawler_pp::exceptions::sitemap_exception::get_path() const {
+  return this->path_;
+}
+
+std::ostream& crawler_pp::exceptions::operator<<(std::ostream &os,
+						  const crawler_pp::exceptions::sitemap_exception &err){
+  os << err.get_message() << " (sitemap file: " << err.get_path() << ")";
+  return os;
+}
+
+crawler_pp::exceptions::sitemap_exception::~sitemap_exception() throw() {}
+
 // === class not_implemented_exception ========================================
 crawler_pp::exceptions::not_implemented_exception::not_implemented_exception(const std::string &message)
   :exception(message) {}
@@ -7,6 +7,8 @@
 //   *exception
 //   *uri_exception
 //   *db_exception
+//   *warc_exception
+//   *sitemap_exception
 //   *not_implemented_exception
 // ============================================================================
 
@@ -68,6 +70,42 @@ namespace crawler_pp {
       virtual ~db_exception() throw();
     };
 
+    // The class for all bad WARC files and WARC processing errors
+    class warc_exception : public exception {
+    public:
+      // We want no default constructor
+      warc_exception() = delete;
+      // The constructor for this class requires two arguments:
+      // 1: the actual error message
+      // 2: the path of the WARC file causing the actual error
+      warc_exception(const std::string&, const std::string&);
+      // A getter method for the path member
+      std::string get_path() const;
+      // The destructor of this class
+      virtual ~warc_exception() throw();
+    protected:
+      // The path member of this class
+      std::string path_;
+    }; // end of class warc_exception
+
+    // The class for all unreadable sitemap files
+    class sitemap_exception : public exception {
+    public:
+      // We want no default constructor
+      sitemap_exception() = delete;
+      // The constructor for this class requires two arguments:
+      // 1: the actual error message
+      // 2: the path of the sitemap file causing the actual error
+      sitemap_exception(const std::string&, const std::string&);
+      // A getter method for the path member
+      std::string get_path() const;
+      // The destructor of this class
+      virtual ~sitemap_exception() throw();
+    protected:
+      // The path member of this class
+      std::string path_;
+    }; // end of class sitemap_exception
+
     // The class for exception handling of not implemented code segments
     class not_implemented_exception : public exception {
     public:
@@ -82,6 +120,10 @@ namespace crawler_pp {
     std::ostream& operator<<(std::ostream&, const crawler_pp::exceptions::exception&);
 
     std::ostream& operator<<(std::ostream &, const crawler_pp::exceptions::uri_exception &);
+
+    std::ostream& operator<<(std::ostream &, const crawler_pp::exceptions::warc_exception &);
+
+    std::ostream& operator<<(std::ostream &, const crawler_pp::exceptions::sitemap_exception &);
   } // end of namespace exceptions
 } // end of namespace crawler_pp
 #endif // EXCEPTIONS_H
@@ -0,0 +1,118 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: host_controller.cpp
+// Description: This implementation file implements the host_controller class
+//              that adapts the concurrency and the inter-request delay of a
+//              single host to the observed latency and error rates (AIMD).
+// Public interfaces:
+//   * controller_options
+//   * host_metrics
+//   * host_controller
+// ============================================================================
+
+
+#include "host_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::chrono::milliseconds;
+using crawler_pp::download::download_result;
+
+crawler_pp::scheduling::host_controller::host_controller(const crawler_pp::scheduling::controller_options &options)
+  :options_(options), limit_(options.initial_concurrency), in_flight_(0),
+   delay_(options.initial_delay), latency_(-1), baseline_(-1), error_rate_(0),
+   last_start_(), last_decrease_(), blocked_until_(), requests_(0), errors_(0),
+   throttled_(0), increases_(0), decreases_(0) {}
+
+bool crawler_pp::scheduling::host_controller::try_acquire(clock::time_point now){
+  if(now < this->next_allowed()) return false;
+  if(this->in_flight_ >= std::max<size_t>(1, static_cast<size_t>(std::floor(this->limit_)))) return false;
+  ++this->in_flight_;
+  this->last_start_ = now;
+  return true;
+}
+
+crawler_pp::scheduling::host_controller::clock::time_point
+  crawler_pp::scheduling::host_controller::next_allowed() const {
+  if(this->last_start_ == clock::time_point()) return this->blocked_until_;
+  return std::max(this->blocked_until_, this->last_start_ + this->delay_);
+}
+
+void crawler_pp::scheduling::host_controller::release(const download_result &result,
+						       clock::time_point now){
+  if(this->in_flight_) --this->in_flight_;
+  ++this->requests_;
+  const bool throttled(result.status == 429 || result.status == 503);
+  const bool failed(!result.status || (result.status >= 500 && !throttled));
+  this->error_rate_ += this->options_.smoothing * ((throttled || failed ? 1. : 0.) - this->error_rate_);
+
+  if(throttled || failed) {
+    if(throttled) ++this->throttled_;
+    else ++this->errors_;
+    if(result.retry_after.count() > 0)
+      this->blocked_until_ = std::max(this->blocked_until_, now + result.retry_after);
+    if(this->decrease(now))
+      this->delay_ = std::min(this->options_.max_delay,
+			      std::max(this->delay_ * 2, std::max(this->options_.initial_delay,
+								  milliseconds(1))));
+    return;
+  }
+
+  const double sample(static_cast<double>(result.latency.count()));
+  if(this->latency_ < 0) {
+    this->latency_ = this->baseline_ = sample;
+  } else {
+    this->latency_ += this->options_.smoothing * (sample - this->latency_);
+    // The baseline follows the average slowly, so a host that became slower
+    // for good is not treated as congested forever.
+    this->baseline_ = std::min(sample, this->baseline_ + 0.01 * (this->latency_ - this->baseline_));
+  }
+
+  // A delay of 1/8th is dropped at least, so a host recovers from a long
+  // delay within a few requests.
+  this->delay_ = std::max(this->options_.min_delay,
+			  this->delay_ - std::max(this->options_.delay_decrease, this->delay_ / 8));
+  if(this->latency_ > this->options_.latency_tolerance * std::max(this->baseline_, 1.)) {
+    this->decrease(now);
+  } else if(this->in_flight_ + 1 >= static_cast<size_t>(this->limit_)) {
+    // The limit only grows while it is exhausted, otherwise an idle or
+    // delayed host would collect a limit that was never probed.
+    // Growing by additive_increase / limit per response grows the limit by
+    // additive_increase per round trip.
+    this->limit_ = std::min(this->options_.max_concurrency,
+			    this->limit_ + this->options_.additive_increase / this->limit_);
+    ++this->increases_;
+  }
+}
+
+bool crawler_pp::scheduling::host_controller::decrease(clock::time_point now){
+  // All requests in flight during a congestion report it, but the limit
+  // should be shrunk once per congestion only.
+  const milliseconds round_trip(static_cast<milliseconds::rep>(std::max(this->latency_, 0.)));
+  if(this->last_decrease_ != clock::time_point() && now < this->last_decrease_ + round_trip) return false;
+  this->limit_ = std::max(this->options_.min_concurrency,
+			  this->limit_ * this->options_.multiplicative_decrease);
+  this->last_decrease_ = now;
+  ++this->decreases_;
+  return true;
+}
+
+crawler_pp::scheduling::host_metrics
+  crawler_pp::scheduling::host_controller::get_metrics(clock::time_point now) const {
+  crawler_pp::scheduling::host_metrics metrics;
+  metrics.concurrency_limit = this->limit_;
+  metrics.in_flight = this->in_flight_;
+  metrics.delay = this->delay_;
+  metrics.latency = milliseconds(static_cast<milliseconds::rep>(std::max(this->latency_, 0.)));
+  metrics.baseline_latency = milliseconds(static_cast<milliseconds::rep>(std::max(this->baseline_, 0.)));
+  metrics.error_rate = this->error_rate_;
+  metrics.blocked_for = this->blocked_until_ > now ?
+    std::chrono::duration_cast<milliseconds>(this->blocked_until_ - now) : milliseconds(0);
+  metrics.requests = this->requests_;
+  metrics.errors = this->errors_;
+  metrics.throttled = this->throttled_;
+  metrics.increases = this->increases_;
+  metrics.decreases = this->decreases_;
+  return metrics;
+}
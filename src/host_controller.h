@@ -0,0 +1,121 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: host_controller.h
+// Description: This header file defines the host_controller class that
+//              adapts the concurrency and the inter-request delay of a single
+//              host to the observed latency and error rates (AIMD).
+// Public interfaces:
+//   * controller_options
+//   * host_metrics
+//   * host_controller
+// ============================================================================
+
+
+#ifndef HOST_CONTROLLER_H
+#define HOST_CONTROLLER_H
+
+#include "page_downloader.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace crawler_pp {
+  namespace scheduling {
+
+    // Bundles all parameters of a host_controller.
+    struct controller_options {
+      // The concurrency limit of a host that was not requested yet
+      double initial_concurrency = 2;
+      // The lower bound of the concurrency limit
+      double min_concurrency = 1;
+      // The upper bound of the concurrency limit
+      double max_concurrency = 64;
+      // The concurrency limit grows by this value per round trip
+      double additive_increase = 1;
+      // The concurrency limit is multiplied by this value on congestion
+      double multiplicative_decrease = 0.5;
+      // A latency above latency_tolerance times the baseline latency of a
+      // host is treated as congestion
+      double latency_tolerance = 1.5;
+      // The weight of a new sample in the moving averages
+      double smoothing = 0.2;
+      // The inter-request delay of a host that was not requested yet
+      std::chrono::milliseconds initial_delay = std::chrono::milliseconds(250);
+      // The lower bound of the inter-request delay
+      std::chrono::milliseconds min_delay = std::chrono::milliseconds(0);
+      // The upper bound of the inter-request delay
+      std::chrono::milliseconds max_delay = std::chrono::milliseconds(60000);
+      // The inter-request delay shrinks by this value per successful request
+      std::chrono::milliseconds delay_decrease = std::chrono::milliseconds(25);
+    }; // end of struct controller_options
+
+    // A snapshot of the state and the decisions of a host_controller.
+    struct host_metrics {
+      double concurrency_limit;
+      size_t in_flight;
+      std::chrono::milliseconds delay;
+      std::chrono::milliseconds latency;
+      std::chrono::milliseconds baseline_latency;
+      double error_rate;
+      // The time until requests are blocked because of a Retry-After header
+      std::chrono::milliseconds blocked_for;
+      uint64_t requests;
+      uint64_t errors;
+      uint64_t throttled;
+      uint64_t increases;
+      uint64_t decreases;
+    }; // end of struct host_metrics
+
+    // This class controls the requests of a single host: a request may only
+    // be started if less than the concurrency limit are in flight and the
+    // inter-request delay has passed. Fast and healthy responses grow the
+    // limit additively and shrink the delay, errors, 429/503 responses and
+    // latencies above the tolerance shrink the limit multiplicatively and
+    // errors double the delay, both at most once per round trip.
+    // Retry-After headers block the host. This class is not thread safe, see
+    // crawler_pp::scheduling::scheduler.
+    class host_controller {
+    public:
+      typedef std::chrono::steady_clock clock;
+
+      // This constructor takes the parameters of the controller.
+      host_controller(const controller_options&);
+      // Returns true and registers a new request in flight if a request may
+      // be started at the passed time.
+      bool try_acquire(clock::time_point);
+      // Returns the earliest time a request may be started, ignoring the
+      // concurrency limit.
+      clock::time_point next_allowed() const;
+      // Unregisters a finished request and adapts the concurrency limit and
+      // the delay to its outcome.
+      void release(const crawler_pp::download::download_result&, clock::time_point);
+      // Returns a snapshot of the state of this controller.
+      host_metrics get_metrics(clock::time_point) const;
+    private:
+      // Shrinks the concurrency limit once per round trip. Returns false if
+      // the limit was already shrunk during the current round trip.
+      bool decrease(clock::time_point);
+
+      controller_options options_;
+      double limit_;
+      size_t in_flight_;
+      std::chrono::milliseconds delay_;
+      // The moving average of the latency in milliseconds
+      double latency_;
+      // The lowest latency observed recently in milliseconds
+      double baseline_;
+      double error_rate_;
+      clock::time_point last_start_;
+      clock::time_point last_decrease_;
+      clock::time_point blocked_until_;
+      uint64_t requests_;
+      uint64_t errors_;
+      uint64_t throttled_;
+      uint64_t increases_;
+      uint64_t decreases_;
+    }; // end of class host_controller
+  } // end of namespace scheduling
+} // end of namespace crawler_pp
+
+#endif // HOST_CONTROLLER_H
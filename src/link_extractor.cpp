@@ -0,0 +1,198 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: link_extractor.cpp
+// Description: This implementation file implements the functions that
+//              extract the links of a downloaded HTML page. The page is
+//              scanned once without building a DOM.
+// Public interfaces:
+//   * extract_links
+//   * extract_page
+//   * resolve_reference
+// ============================================================================
+
+
+#include "link_extractor.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace {
+  inline char lower(char c){
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+
+  inline bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+  }
+
+  // Returns true if [begin, end) equals the lower case string name
+  // (case-insensitive).
+  bool equals(const char *begin, const char *end, const char *name){
+    const size_t size(std::strlen(name));
+    if(static_cast<size_t>(end - begin) != size) return false;
+    for(size_t i(0); i != size; ++i)
+      if(lower(begin[i]) != name[i]) return false;
+    return true;
+  }
+
+  // Returns the passed attribute value with the character references
+  // "&amp;" replaced and surrounding white space removed.
+  string decode_value(const char *begin, const char *end){
+    while(begin != end && is_space(*begin)) ++begin;
+    while(end != begin && is_space(*(end - 1))) --end;
+    string result;
+    result.reserve(end - begin);
+    for(const char *it(begin); it != end; ++it) {
+      if(*it == '&' && end - it >= 5 && !std::memcmp(it, "&amp;", 5)) {
+	result += '&';
+	it += 4;
+      } else if(*it != '\n' && *it != '\r' && *it != '\t') {
+	result += *it;
+      }
+    }
+    return result;
+  }
+
+  // Returns the length of the scheme of the passed reference including the
+  // colon or 0 if the reference is relative.
+  size_t scheme_length(const string &reference){
+    for(size_t i(0); i != reference.size(); ++i) {
+      const char c(reference[i]);
+      if(c == ':') return i ? i + 1 : 0;
+      if(!std::isalnum(static_cast<unsigned char>(c)) && c != '+' && c != '-' && c != '.') return 0;
+      if(!i && !std::isalpha(static_cast<unsigned char>(c))) return 0;
+    }
+    return 0;
+  }
+
+  // Returns true if the passed absolute uri has the scheme http or https.
+  bool is_http(const string &uri){
+    return (uri.size() > 7 && equals(uri.data(), uri.data() + 7, "http://")) ||
+      (uri.size() > 8 && equals(uri.data(), uri.data() + 8, "https://"));
+  }
+} // end of anonymous namespace
+
+string crawler_pp::extraction::resolve_reference(const string &base, const string &reference){
+  if(scheme_length(reference)) return reference;
+  const size_t scheme_end(base.find(':'));
+  if(scheme_end == string::npos) return reference;
+  if(reference.compare(0, 2, "//") == 0) return base.substr(0, scheme_end + 1) + reference;
+
+  const size_t authority_begin(base.compare(scheme_end + 1, 2, "//") == 0 ? scheme_end + 3 : scheme_end + 1);
+  size_t path_begin(base.find_first_of("/?#", authority_begin));
+  if(path_begin == string::npos) path_begin = base.size();
+  size_t query_begin(base.find_first_of("?#", path_begin));
+  if(query_begin == string::npos) query_begin = base.size();
+
+  if(reference.empty()) return base.substr(0, base.find('#'));
+  if(reference[0] == '#') return base.substr(0, base.find('#')) + reference;
+  if(reference[0] == '?') return base.substr(0, query_begin) + reference;
+  if(reference[0] == '/') return base.substr(0, path_begin) + reference;
+
+  // Merge the reference with the path of the base up to the last slash
+  const size_t last_slash(base.rfind('/', query_begin - 1));
+  if(last_slash == string::npos || last_slash < path_begin) return base.substr(0, path_begin) + "/" + reference;
+  return base.substr(0, last_slash + 1) + reference;
+}
+
+void crawler_pp::extraction::extract_links(const char *html, size_t size, const string &base_uri,
+					   vector<string> &links){
+  const char *end(html + size);
+  string base(base_uri);
+  const char *it(html);
+  while((it = std::find(it, end, '<')) != end) {
+    ++it;
+    // Skip comments, they may contain arbitrary markup
+    if(end - it >= 3 && !std::memcmp(it, "!--", 3)) {
+      static const char COMMENT_END[] = "-->";
+      it = std::search(it + 3, end, COMMENT_END, COMMENT_END + 3);
+      continue;
+    }
+    const char *name(it);
+    while(it != end && std::isalpha(static_cast<unsigned char>(*it))) ++it;
+    const char *name_end(it);
+    const char *attribute_name;
+    if(equals(name, name_end, "a") || equals(name, name_end, "area") ||
+       equals(name, name_end, "link") || equals(name, name_end, "base")) {
+      attribute_name = "href";
+    } else if(equals(name, name_end, "frame") || equals(name, name_end, "iframe")) {
+      attribute_name = "src";
+    } else if(equals(name, name_end, "script") || equals(name, name_end, "style")) {
+      // The content of script and style elements is no markup
+      const bool script(lower(*name) == 's' && lower(name[1]) == 'c');
+      const char *close(script ? "</script" : "</style");
+      const size_t close_size(std::strlen(close));
+      while((it = std::find(it, end, '<')) != end) {
+	if(end - it >= static_cast<std::ptrdiff_t>(close_size) &&
+	   equals(it, it + close_size, close)) break;
+	++it;
+      }
+      continue;
+    } else {
+      continue;
+    }
+
+    // Scan the attributes up to the end of the tag
+    while(it != end && *it != '>') {
+      while(it != end && (is_space(*it) || *it == '/')) ++it;
+      const char *attribute(it);
+      while(it != end && !is_space(*it) && *it != '=' && *it != '>') ++it;
+      const char *attribute_end(it);
+      while(it != end && is_space(*it)) ++it;
+      if(it == end || *it != '=') {
+	if(attribute == attribute_end && it != end && *it != '>') ++it;
+	continue;
+      }
+      ++it;
+      while(it != end && is_space(*it)) ++it;
+      const char *value(it);
+      const char *value_end;
+      if(it != end && (*it == '"' || *it == '\'')) {
+	const char quote(*it);
+	value = ++it;
+	it = std::find(it, end, quote);
+	value_end = it;
+	if(it != end) ++it;
+      } else {
+	while(it != end && !is_space(*it) && *it != '>') ++it;
+	value_end = it;
+      }
+      if(!equals(attribute, attribute_end, attribute_name)) continue;
+
+      const string reference(decode_value(value, value_end));
+      if(equals(name, name_end, "base")) {
+	base = resolve_reference(base_uri, reference);
+      } else if(!reference.empty() && reference[0] != '#') {
+	string link(resolve_reference(base, reference));
+	if(is_http(link)) {
+	  // The fragment never changes the requested page
+	  const size_t fragment(link.find('#'));
+	  if(fragment != string::npos) link.erase(fragment);
+	  links.push_back(link);
+	}
+      }
+    }
+  }
+}
+
+bool crawler_pp::extraction::extract_page(const crawler_pp::download::http_response &response, const string &uri,
+					  uint64_t &content, vector<string> &links){
+  if(response.status != 200 ||
+     crawler_pp::utils::string_to_lower(response.get_header("Content-Type")).find("html") == string::npos)
+    return false;
+  if(crawler_pp::utils::string_to_lower(response.get_header("Transfer-Encoding")).find("chunked") != string::npos) {
+    string body;
+    crawler_pp::download::decode_chunked(response.body, response.body_length, body);
+    content = crawler_pp::utils::simhash(body.data(), body.size());
+    extract_links(body.data(), body.size(), uri, links);
+  } else {
+    content = crawler_pp::utils::simhash(response.body, response.body_length);
+    extract_links(response.body, response.body_length, uri, links);
+  }
+  return true;
+}
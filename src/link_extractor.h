@@ -0,0 +1,48 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: link_extractor.h
+// Description: This header file declares the functions that extract the
+//              links of a downloaded HTML page.
+// Public interfaces:
+//   * extract_links
+//   * extract_page
+//   * resolve_reference
+// ============================================================================
+
+
+#ifndef LINK_EXTRACTOR_H
+#define LINK_EXTRACTOR_H
+
+#include "page_downloader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace crawler_pp {
+  namespace extraction {
+
+    // Appends all HTTP and HTTPS links (the href attributes of a, area and
+    // link tags and the src attributes of frame and iframe tags) of the
+    // passed HTML page to the passed vector. Relative links are resolved
+    // against the passed base uri or the href of a base tag. The links are
+    // not normalized, see crawler_pp::policies::crawl_frontend::normalize.
+    void extract_links(const char*, size_t, const std::string&, std::vector<std::string>&);
+
+    // Analyzes the passed parsed response of the passed uri like a crawl
+    // does: if it is an HTML page with the status 200 its (decoded) body is
+    // fingerprinted (see crawler_pp::utils::simhash) and its links are
+    // appended to the passed vector. Returns false if the response is no
+    // such page.
+    bool extract_page(const crawler_pp::download::http_response&, const std::string&, uint64_t&,
+		      std::vector<std::string>&);
+
+    // Returns the passed reference resolved against the passed absolute
+    // base uri (see RFC 3986, section 5.2). Dot segments are not removed,
+    // this is done by the normalization of the resolved uri.
+    std::string resolve_reference(const std::string&, const std::string&);
+  } // end of namespace extraction
+} // end of namespace crawler_pp
+
+#endif // LINK_EXTRACTOR_H
@@ -1 +1,348 @@
-#include "page_downloader_h"
+// ============================================================================
+// Author: Lukas Georgieff
+// File: page_downloader.cpp
+// Description: This implementation file implements the page downloader and
+//              the types that are used to parse a response and to report the
+//              outcome of a page request.
+// Public interfaces:
+//   * download_result
+//   * parse_retry_after
+//   * http_response
+//   * parse_http_response
+//   * decode_chunked
+//   * fetch_options
+//   * fetch_response
+//   * async_fetch
+// ============================================================================
+
+
+#include "page_downloader.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+#if __cplusplus >= 202002L
+  #include <cerrno>
+
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/epoll.h>
+  #include <unistd.h>
+#endif
+
+std::chrono::seconds crawler_pp::download::parse_retry_after(const std::string &value,
+							     std::chrono::system_clock::time_point now){
+  size_t begin(value.find_first_not_of(" \t"));
+  if(begin == std::string::npos) return std::chrono::seconds(0);
+  size_t end(value.find_last_not_of(" \t") + 1);
+
+  // delay-seconds = 1*DIGIT
+  bool digits(true);
+  for(size_t i(begin); i != end && digits; ++i) digits = std::isdigit(static_cast<unsigned char>(value[i]));
+  if(digits) {
+    if(end - begin > 9) return std::chrono::seconds(0);
+    return std::chrono::seconds(std::stol(value.substr(begin, end - begin)));
+  }
+
+  // HTTP-date, only the preferred IMF-fixdate format is supported, e.g.
+  // "Sun, 06 Nov 1994 08:49:37 GMT"
+  std::tm date;
+  std::memset(&date, 0, sizeof(date));
+  char month[4] = {0};
+  int day(0), year(0), hour(0), minute(0), second(0);
+  if(std::sscanf(value.c_str() + begin, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+		 &day, month, &year, &hour, &minute, &second) != 6)
+    return std::chrono::seconds(0);
+  const char *months("JanFebMarAprMayJunJulAugSepOctNovDec");
+  const char *pos(std::strstr(months, month));
+  if(!pos || std::strlen(month) != 3 || (pos - months) % 3) return std::chrono::seconds(0);
+  date.tm_mday = day;
+  date.tm_mon = static_cast<int>(pos - months) / 3;
+  date.tm_year = year - 1900;
+  date.tm_hour = hour;
+  date.tm_min = minute;
+  date.tm_sec = second;
+  const std::time_t at(timegm(&date));
+  const std::time_t current(std::chrono::system_clock::to_time_t(now));
+  return std::chrono::seconds(at > current ? at - current : 0);
+}
+
+std::string crawler_pp::download::http_response::get_header(const std::string &name) const {
+  const std::string lower(crawler_pp::utils::string_to_lower(name));
+  for(size_t i(0); i != this->headers.size(); ++i)
+    if(crawler_pp::utils::string_to_lower(this->headers[i].first) == lower)
+      return this->headers[i].second;
+  return "";
+}
+
+bool crawler_pp::download::parse_http_response(const char *data, size_t size,
+					       crawler_pp::download::http_response &response){
+  static const char CRLF[] = "\r\n";
+  const char *end(data + size);
+  const char *line_end(std::search(data, end, CRLF, CRLF + 2));
+  // "HTTP/1.1 200 OK"
+  if(line_end == end || line_end - data < 12 || std::memcmp(data, "HTTP/1.", 7)) return false;
+  const char *status(std::find(data, line_end, ' '));
+  if(line_end - status < 4 || !std::isdigit(static_cast<unsigned char>(status[1])) ||
+     !std::isdigit(static_cast<unsigned char>(status[2])) || !std::isdigit(static_cast<unsigned char>(status[3])))
+    return false;
+  response.status = (status[1] - '0') * 100 + (status[2] - '0') * 10 + (status[3] - '0');
+
+  response.headers.clear();
+  const char *line(line_end + 2);
+  while(true) {
+    line_end = std::search(line, end, CRLF, CRLF + 2);
+    if(line_end == end) return false;
+    if(line_end == line) break;
+    const char *colon(std::find(line, line_end, ':'));
+    if(colon != line_end) {
+      const char *value(colon + 1);
+      while(value != line_end && (*value == ' ' || *value == '\t')) ++value;
+      response.headers.push_back(std::make_pair(std::string(line, colon), std::string(value, line_end)));
+    }
+    line = line_end + 2;
+  }
+  response.body = line_end + 2;
+  response.body_length = end - response.body;
+  return true;
+}
+
+bool crawler_pp::download::decode_chunked(const char *data, size_t size, std::string &body){
+  const char *end(data + size);
+  while(true) {
+    // chunk-size [ chunk-ext ] CRLF chunk-data CRLF
+    const char *line_end(static_cast<const char*>(std::memchr(data, '\n', end - data)));
+    if(!line_end) return false;
+    char *digits_end;
+    const unsigned long length(std::strtoul(data, &digits_end, 16));
+    if(digits_end == data) return false;
+    data = line_end + 1;
+    if(!length) return true;
+    if(static_cast<size_t>(end - data) < length || static_cast<size_t>(end - data) - length < 2) return false;
+    body.append(data, length);
+    data += length + 2;
+  }
+}
+
+#if __cplusplus >= 202002L
+namespace {
+  // Closes the owned socket when the request is done
+  struct socket_guard {
+    ~socket_guard(){
+      if(this->fd >= 0) close(this->fd);
+    }
+    int fd;
+  }; // end of struct socket_guard
+
+  // The framing of a response message that is received incrementally
+  struct message_framing {
+    // The size of the status line and the headers, 0 while incomplete
+    size_t header_size = 0;
+    // The size of the complete message, 0 while it is unknown
+    size_t expected = 0;
+    // True if the body is chunked
+    bool chunked = false;
+    // The offset of the next chunk-size line, or of the next trailer line
+    // after the last chunk
+    size_t next_line = 0;
+    bool trailer = false;
+    // True if the framing of the message is malformed
+    bool invalid = false;
+  }; // end of struct message_framing
+
+  // Parses the passed Content-Length value, returns false if it is not a
+  // single decimal number that fits into size_t.
+  bool parse_content_length(const std::string &value, size_t &length){
+    const size_t begin(value.find_first_not_of(" \t"));
+    if(begin == std::string::npos || !std::isdigit(static_cast<unsigned char>(value[begin]))) return false;
+    errno = 0;
+    char *end;
+    const unsigned long long result(std::strtoull(value.c_str() + begin, &end, 10));
+    if(errno == ERANGE || result > std::numeric_limits<size_t>::max()) return false;
+    while(*end == ' ' || *end == '\t') ++end;
+    if(*end) return false;
+    length = static_cast<size_t>(result);
+    return true;
+  }
+
+  // Parses the chunks and the trailer of a chunked body that were received
+  // since the last call. The chunk-size lines are parsed once, the chunk
+  // data is skipped.
+  void parse_chunks(const std::string &message, message_framing &framing){
+    while(true) {
+      const size_t line_end(message.find("\r\n", framing.next_line));
+      if(line_end == std::string::npos) return;
+      if(framing.trailer) {
+	// The trailer ends with an empty line
+	if(line_end == framing.next_line) {
+	  framing.expected = line_end + 2;
+	  return;
+	}
+	framing.next_line = line_end + 2;
+	continue;
+      }
+      // chunk-size [ chunk-ext ] CRLF chunk-data CRLF
+      const char *digits(message.c_str() + framing.next_line);
+      if(!std::isxdigit(static_cast<unsigned char>(*digits))) {
+	framing.invalid = true;
+	return;
+      }
+      errno = 0;
+      char *digits_end;
+      const unsigned long long size(std::strtoull(digits, &digits_end, 16));
+      if(errno == ERANGE || size > std::numeric_limits<size_t>::max() / 2 ||
+	 (*digits_end != ';' && *digits_end != ' ' && *digits_end != '\t' && *digits_end != '\r')) {
+	framing.invalid = true;
+	return;
+      }
+      if(!size) {
+	framing.trailer = true;
+	framing.next_line = line_end + 2;
+	continue;
+      }
+      const size_t data(line_end + 2);
+      if(message.size() - data < size + 2) return;
+      if(message.compare(data + size, 2, "\r\n")) {
+	framing.invalid = true;
+	return;
+      }
+      framing.next_line = data + size + 2;
+    }
+  }
+
+  // Updates the framing by the received bytes of the passed message. If the
+  // message is complete, framing.expected is set. A response without
+  // Content-Length and chunked body ends when the connection is closed.
+  void update_framing(const std::string &message, message_framing &framing){
+    if(!framing.header_size) {
+      const size_t end(message.find("\r\n\r\n"));
+      if(end == std::string::npos) return;
+      framing.header_size = end + 4;
+      crawler_pp::download::http_response response;
+      if(!crawler_pp::download::parse_http_response(message.data(), framing.header_size, response)) {
+	framing.invalid = true;
+	return;
+      }
+      if(response.status == 204 || response.status == 304 || response.status / 100 == 1) {
+	framing.expected = framing.header_size;
+	return;
+      }
+      // Transfer-Encoding overrides Content-Length
+      if(crawler_pp::utils::string_to_lower(response.get_header("Transfer-Encoding")).find("chunked") !=
+	 std::string::npos) {
+	framing.chunked = true;
+	framing.next_line = framing.header_size;
+      } else {
+	const std::string value(response.get_header("Content-Length"));
+	size_t length;
+	if(value.empty()) return;
+	if(!parse_content_length(value, length) || length > std::numeric_limits<size_t>::max() - framing.header_size) {
+	  framing.invalid = true;
+	  return;
+	}
+	framing.expected = framing.header_size + length;
+	return;
+      }
+    }
+    if(framing.chunked) parse_chunks(message, framing);
+  }
+} // end of anonymous namespace
+
+crawler_pp::async::task<crawler_pp::download::fetch_response>
+  crawler_pp::download::async_fetch(const crawler_pp::resolving::resolved_address &address,
+				    const std::string &uri, const crawler_pp::download::fetch_options &options){
+  typedef crawler_pp::async::event_loop::clock clock;
+  crawler_pp::async::event_loop &loop(*crawler_pp::async::event_loop::current());
+  const clock::time_point start(clock::now()), deadline(start + options.timeout);
+  fetch_response response;
+  if(uri.compare(0, 7, "http://")) co_return response;
+  const std::string authority(crawler_pp::utils::uri_authority(uri));
+  size_t path(uri.find_first_of("/?#", 7));
+  std::string target(path == std::string::npos ? "/" : uri.substr(path, uri.find('#', path) - path));
+  if(target.empty() || target[0] != '/') target.insert(0, "/");
+  response.request = "GET " + target + " HTTP/1.1\r\nHost: " + authority + "\r\nUser-Agent: " +
+    options.user_agent + "\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+
+  socket_guard socket_fd{socket(address.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+  if(socket_fd.fd < 0) co_return response;
+  const int one(1);
+  setsockopt(socket_fd.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if(connect(socket_fd.fd, reinterpret_cast<const sockaddr*>(&address.address), address.length)) {
+    if(errno != EINPROGRESS) co_return response;
+    if(!(co_await loop.wait(socket_fd.fd, EPOLLOUT, deadline))) co_return response;
+    int error(0);
+    socklen_t length(sizeof(error));
+    if(getsockopt(socket_fd.fd, SOL_SOCKET, SO_ERROR, &error, &length) || error) co_return response;
+  }
+  response.connected = true;
+
+  for(size_t sent(0); sent < response.request.size(); ) {
+    const ssize_t count(send(socket_fd.fd, response.request.data() + sent, response.request.size() - sent,
+			     MSG_NOSIGNAL));
+    if(count >= 0) {
+      sent += count;
+    } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      if(!(co_await loop.wait(socket_fd.fd, EPOLLOUT, deadline))) co_return response;
+    } else if(errno != EINTR) {
+      co_return response;
+    }
+  }
+
+  // Each loop reads into its own buffer and the message grows with the
+  // response, so a fetch that waits for its response needs no buffer
+  static thread_local char buffer[1 << 16];
+  message_framing framing;
+  while(true) {
+    const ssize_t count(recv(socket_fd.fd, buffer,
+			     std::min(sizeof(buffer), options.max_size + 1 - response.message.size()), 0));
+    if(count > 0) {
+      response.message.append(buffer, count);
+      if(response.message.size() > options.max_size) {
+	response.message.resize(options.max_size);
+	response.truncated = true;
+	break;
+      }
+      if(!framing.expected) update_framing(response.message, framing);
+      if(framing.invalid) {
+	response.message.clear();
+	co_return response;
+      }
+      if(framing.expected && response.message.size() >= framing.expected) {
+	response.message.resize(framing.expected);
+	break;
+      }
+    } else if(!count) {
+      // A peer that closes the connection before the Content-Length or the
+      // last chunk was received sent a truncated page
+      if((framing.expected && response.message.size() < framing.expected) ||
+	 (framing.chunked && !framing.expected)) {
+	response.message.clear();
+	co_return response;
+      }
+      break;
+    } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      if(!(co_await loop.wait(socket_fd.fd, EPOLLIN | EPOLLRDHUP, deadline))) {
+	response.message.clear();
+	co_return response;
+      }
+    } else if(errno != EINTR) {
+      response.message.clear();
+      co_return response;
+    }
+  }
+
+  http_response parsed;
+  if(parse_http_response(response.message.data(), response.message.size(), parsed)) {
+    response.result.status = parsed.status;
+    response.result.retry_after = parse_retry_after(parsed.get_header("Retry-After"), std::chrono::system_clock::now());
+  }
+  response.result.latency = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start);
+  co_return response;
+}
+#endif
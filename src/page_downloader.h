@@ -1,4 +1,117 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: page_downloader.h
+// Description: This header file defines the page downloader that requests
+//              pages by HTTP/1.1 on non-blocking sockets (C++20 only) and
+//              the types that are used to parse a response and to report the
+//              outcome of a page request.
+// Public interfaces:
+//   * download_result
+//   * parse_retry_after
+//   * http_response
+//   * parse_http_response
+//   * decode_chunked
+//   * fetch_options
+//   * fetch_response
+//   * async_fetch
+// ============================================================================
+
+
 #ifndef PAGE_DOWNLOADER_H
 #define PAGE_DOWNLOADER_H
 
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L
+  #include "address_resolver.h"
+  #include "event_loop.h"
+#endif
+
+namespace crawler_pp {
+  namespace download {
+
+    // The outcome of a single page request
+    struct download_result {
+      // The HTTP status code of the response or 0 if the request failed
+      // because of a network error
+      int status;
+      // The time from sending the request until the response was received
+      std::chrono::milliseconds latency;
+      // The value of the Retry-After header or 0 if the response had none
+      std::chrono::seconds retry_after;
+    }; // end of struct download_result
+
+    // Returns the delay defined by the value of a Retry-After header, i.e.
+    // either delay-seconds or an HTTP-date that is relative to the passed
+    // time. If the value cannot be parsed or lies in the past, 0 is
+    // returned.
+    std::chrono::seconds parse_retry_after(const std::string&,
+					   std::chrono::system_clock::time_point);
+
+    // A parsed HTTP response. The body points into the parsed buffer.
+    struct http_response {
+      // The status code of the response
+      int status;
+      // All headers of the response in the order of the message
+      std::vector<std::pair<std::string, std::string> > headers;
+      // The body of the response (not decoded)
+      const char *body;
+      // The size of the body in bytes
+      size_t body_length;
+      // Returns the value of the passed header (case-insensitive) or an
+      // empty string if the response has no such header.
+      std::string get_header(const std::string&) const;
+    }; // end of struct http_response
+
+    // Parses the passed buffer that contains a complete HTTP/1.x response,
+    // i.e. the status line, the headers and the body. Returns false if the
+    // buffer does not start with a valid status line and headers.
+    bool parse_http_response(const char*, size_t, http_response&);
+
+    // Appends the decoded body of the passed buffer that contains a body
+    // with the chunked transfer coding to the passed string. Returns false
+    // if the buffer is malformed or ends before the last chunk.
+    bool decode_chunked(const char*, size_t, std::string&);
+
+#if __cplusplus >= 202002L
+    // Bundles all parameters of async_fetch.
+    struct fetch_options {
+      // Larger responses are truncated
+      size_t max_size = 8 << 20;
+      // The maximum time from connecting until the response is complete
+      std::chrono::milliseconds timeout = std::chrono::milliseconds(30000);
+      // The value of the User-Agent header
+      std::string user_agent = "crawler_pp";
+    }; // end of struct fetch_options
+
+    // A complete page request
+    struct fetch_response {
+      // The outcome of the request
+      download_result result = download_result{0, std::chrono::milliseconds(0), std::chrono::seconds(0)};
+      // The HTTP request message
+      std::string request;
+      // The HTTP response message, see parse_http_response
+      std::string message;
+      // True if the response exceeded fetch_options::max_size
+      bool truncated = false;
+      // True if the connection to the address was established, otherwise
+      // another address of the host may be tried
+      bool connected = false;
+    }; // end of struct fetch_response
+
+    // Requests the passed http uri from the passed address by a GET request
+    // on a non-blocking socket, i.e. the awaiting coroutine is suspended on
+    // its event loop while the socket is not ready. Network errors and
+    // timeouts are reported by the status 0. HTTPS is not supported yet,
+    // such uris fail with the status 0 as well.
+    crawler_pp::async::task<fetch_response> async_fetch(const crawler_pp::resolving::resolved_address&,
+							 const std::string &uri, const fetch_options&);
+#endif
+  } // end of namespace download
+} // end of namespace crawler_pp
+
 #endif // PAGE_DOWNLOADER_H
@@ -0,0 +1,48 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: replay_benchmark.cpp
+// Description: This file contains a command line tool that replays WARC files
+//              through the crawl pipeline and prints the throughput and the
+//              memory usage, i.e. it benchmarks the pipeline without network.
+// Public interfaces:
+//   * int main(int, char**)
+// ============================================================================
+
+#include "crawl_frontend.h"
+#include "crawl_policy.h"
+#include "exceptions.h"
+#include "warc_replay.h"
+
+#include <iostream>
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+// The pipeline of the benchmark keeps the frontier and the visited uris in
+// memory, so the measured throughput does not depend on the DB.
+typedef crawler_pp::policies::crawl_policy<
+  crawler_pp::policies::http_schemes,
+  crawler_pp::policies::fixed_max_size<2048>,
+  crawler_pp::policies::normalization<network::uri_comparison_level::syntax_based>,
+  crawler_pp::policies::memory_frontier,
+  crawler_pp::policies::memory_dedup> replay_policy;
+
+int main(int argc, char **argv){
+  if(argc < 2) {
+    cerr << "usage: " << argv[0] << " <file.warc[.gz]>..." << endl;
+    return 1;
+  }
+
+  crawler_pp::policies::crawl_frontend<replay_policy> frontend;
+  crawler_pp::warc::warc_replay<replay_policy> replay(frontend);
+  try {
+    for(int i(1); i != argc; ++i) replay.replay(argv[i]);
+  } catch(crawler_pp::exceptions::warc_exception &err) {
+    cerr << err << endl;
+    return 1;
+  }
+  cout << replay.get_stats()
+       << "waiting: " << frontend.get_frontier().size() << endl;
+  return 0;
+}
@@ -1 +1,80 @@
-#incude "scheduler.h"
+// ============================================================================
+// Author: Lukas Georgieff
+// File: scheduler.cpp
+// Description: This implementation file implements the scheduler class that
+//              decides when the uri of a host may be requested.
+// Public interfaces:
+//   * scheduler
+// ============================================================================
+
+
+#include "scheduler.h"
+#include "utils.h"
+
+using std::string;
+using std::vector;
+using crawler_pp::scheduling::host_controller;
+using crawler_pp::scheduling::host_metrics;
+
+crawler_pp::scheduling::scheduler::scheduler(const crawler_pp::scheduling::controller_options &options)
+  :options_(options) {}
+
+host_controller& crawler_pp::scheduling::scheduler::get_controller(const string &host){
+  std::unordered_map<string, host_controller>::iterator it(this->hosts_.find(host));
+  if(it == this->hosts_.end())
+    it = this->hosts_.insert(std::make_pair(host, host_controller(this->options_))).first;
+  return it->second;
+}
+
+bool crawler_pp::scheduling::scheduler::try_acquire(const crawler_pp::data::uri &uri,
+						     clock::time_point now){
+  const string host(crawler_pp::utils::uri_authority(uri.get_value()));
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->get_controller(host).try_acquire(now);
+}
+
+crawler_pp::scheduling::scheduler::clock::time_point
+  crawler_pp::scheduling::scheduler::next_allowed(const crawler_pp::data::uri &uri){
+  const string host(crawler_pp::utils::uri_authority(uri.get_value()));
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->get_controller(host).next_allowed();
+}
+
+void crawler_pp::scheduling::scheduler::release(const crawler_pp::data::uri &uri,
+						 const crawler_pp::download::download_result &result,
+						 clock::time_point now){
+  const string host(crawler_pp::utils::uri_authority(uri.get_value()));
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->get_controller(host).release(result, now);
+}
+
+vector<std::pair<string, host_metrics> >
+  crawler_pp::scheduling::scheduler::get_metrics(clock::time_point now) const {
+  vector<std::pair<string, host_metrics> > result;
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  result.reserve(this->hosts_.size());
+  for(std::unordered_map<string, host_controller>::const_iterator it(this->hosts_.begin());
+      it != this->hosts_.end(); ++it)
+    result.push_back(std::make_pair(it->first, it->second.get_metrics(now)));
+  return result;
+}
+
+void crawler_pp::scheduling::scheduler::write_metrics(std::ostream &os, clock::time_point now) const {
+  const vector<std::pair<string, host_metrics> > metrics(this->get_metrics(now));
+  for(size_t i(0); i != metrics.size(); ++i) {
+    const string label("{host=\"" + metrics[i].first + "\"} ");
+    const host_metrics &m(metrics[i].second);
+    os << "crawler_pp_host_concurrency_limit" << label << m.concurrency_limit << "\n"
+       << "crawler_pp_host_in_flight" << label << m.in_flight << "\n"
+       << "crawler_pp_host_delay_ms" << label << m.delay.count() << "\n"
+       << "crawler_pp_host_latency_ms" << label << m.latency.count() << "\n"
+       << "crawler_pp_host_baseline_latency_ms" << label << m.baseline_latency.count() << "\n"
+       << "crawler_pp_host_error_rate" << label << m.error_rate << "\n"
+       << "crawler_pp_host_blocked_ms" << label << m.blocked_for.count() << "\n"
+       << "crawler_pp_host_requests_total" << label << m.requests << "\n"
+       << "crawler_pp_host_errors_total" << label << m.errors << "\n"
+       << "crawler_pp_host_throttled_total" << label << m.throttled << "\n"
+       << "crawler_pp_host_increases_total" << label << m.increases << "\n"
+       << "crawler_pp_host_decreases_total" << label << m.decreases << "\n";
+  }
+}
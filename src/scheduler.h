@@ -1,5 +1,63 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: scheduler.h
+// Description: This header file defines the scheduler class that decides
+//              when the uri of a host may be requested. Each host has its own
+//              host_controller that adapts the concurrency and the delay of
+//              the host to the outcome of its requests.
+// Public interfaces:
+//   * scheduler
+// ============================================================================
+
+
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
+#include "host_controller.h"
+#include "page_downloader.h"
+#include "uri.h"
+
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace crawler_pp {
+  namespace scheduling {
+
+    // This class keeps a host_controller for each requested host. All
+    // methods are thread safe.
+    class scheduler {
+    public:
+      typedef host_controller::clock clock;
+
+      // This constructor takes the parameters of all host controllers.
+      scheduler(const controller_options& = controller_options());
+      // Returns true and registers a new request in flight if the passed
+      // uri may be requested at the passed time.
+      bool try_acquire(const crawler_pp::data::uri&, clock::time_point = clock::now());
+      // Returns the earliest time the host of the passed uri may be
+      // requested again.
+      clock::time_point next_allowed(const crawler_pp::data::uri&);
+      // Reports the outcome of a request that was registered by try_acquire.
+      void release(const crawler_pp::data::uri&, const crawler_pp::download::download_result&,
+		   clock::time_point = clock::now());
+      // Returns the metrics of all known hosts.
+      std::vector<std::pair<std::string, host_metrics> > get_metrics(clock::time_point = clock::now()) const;
+      // Writes the metrics of all known hosts in the Prometheus text format.
+      void write_metrics(std::ostream&, clock::time_point = clock::now()) const;
+    private:
+      // Returns the controller of the passed host, a controller is created
+      // for unknown hosts. The caller must hold mutex_.
+      host_controller& get_controller(const std::string&);
+
+      controller_options options_;
+      mutable std::mutex mutex_;
+      std::unordered_map<std::string, host_controller> hosts_;
+    }; // end of class scheduler
+  } // end of namespace scheduling
+} // end of namespace crawler_pp
 
 #endif // SCHEDULER_H
@@ -0,0 +1,204 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: sitemap_ingester.h
+// Description: This header file defines the sitemap_ingester class template
+//              that seeds the frontier of a crawl_frontend with the uris of
+//              local sitemap and sitemap index files. The entries are read
+//              as a stream (see sitemap_reader.h), normalized and pushed to
+//              the frontier in batches of a fixed size, i.e. the memory usage
+//              does not depend on the size of the sitemaps.
+// Public interfaces:
+//   * sitemap_options
+//   * sitemap_stats
+//   * locate_sitemap
+//   * sitemap_ingester
+// ============================================================================
+
+
+#ifndef SITEMAP_INGESTER_H
+#define SITEMAP_INGESTER_H
+
+#include "crawl_frontend.h"
+#include "exceptions.h"
+#include "sitemap_reader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace crawler_pp {
+  namespace extraction {
+
+    // Returns the local path of the sitemap with the passed loc that is
+    // listed by the sitemap index with the passed path: the file with the
+    // last path segment of loc in the directory of the index. An empty
+    // string is returned if no such file exists.
+    inline std::string locate_sitemap(const std::string &loc, const std::string &index_path){
+      std::string name(loc.substr(0, loc.find_first_of("?#")));
+      name.erase(0, name.find_last_of('/') + 1);
+      if(name.empty()) return "";
+      const size_t slash(index_path.find_last_of('/'));
+      const std::string path(slash == std::string::npos ? name : index_path.substr(0, slash + 1) + name);
+      return access(path.c_str(), R_OK) ? "" : path;
+    }
+
+    // Bundles all parameters of a sitemap_ingester.
+    struct sitemap_options {
+      // The number of uris that are pushed to the frontier at once
+      size_t batch_size = 10000;
+      // Entries with a lower <priority> are skipped
+      double min_priority = 0;
+      // Entries whose <lastmod> is older are skipped, entries without
+      // lastmod are always ingested
+      std::chrono::system_clock::time_point modified_since;
+      // The maximum nesting of sitemap indexes that are followed
+      unsigned max_depth = 2;
+      // Maps the loc of a sitemap that is listed in a sitemap index (first
+      // argument, the path of the index is the second one) to a local path.
+      // Sitemaps that are mapped to an empty string are skipped.
+      std::function<std::string(const std::string&, const std::string&)> locate = locate_sitemap;
+    }; // end of struct sitemap_options
+
+    // The counters of a sitemap_ingester
+    struct sitemap_stats {
+      // The sitemap and sitemap index files read
+      uint64_t sitemaps = 0;
+      // The <url> entries read
+      uint64_t entries = 0;
+      // The uris that were pushed to the frontier
+      uint64_t admitted = 0;
+      // The uris that were already known or waiting
+      uint64_t duplicates = 0;
+      // The uris that were rejected by the normalization
+      uint64_t rejected = 0;
+      // The entries and sitemaps that were skipped by the options
+      uint64_t skipped = 0;
+      // The size of all files in bytes (uncompressed)
+      uint64_t bytes = 0;
+      // The time spent in sitemap_ingester::ingest
+      std::chrono::duration<double> elapsed = std::chrono::duration<double>(0);
+      // Returns the number of entries per minute.
+      double entries_per_minute() const {
+	return this->elapsed.count() > 0 ? this->entries * 60 / this->elapsed.count() : 0;
+      }
+    }; // end of struct sitemap_stats
+
+    // Writes the passed sitemap_stats to the given ostream.
+    inline std::ostream& operator<<(std::ostream &os, const sitemap_stats &stats){
+      os << "sitemaps: " << stats.sitemaps << "\n"
+	 << "entries: " << stats.entries << "\n"
+	 << "admitted: " << stats.admitted << "\n"
+	 << "duplicates: " << stats.duplicates << "\n"
+	 << "rejected: " << stats.rejected << "\n"
+	 << "skipped: " << stats.skipped << "\n"
+	 << "bytes: " << stats.bytes << "\n"
+	 << "seconds: " << stats.elapsed.count() << "\n"
+	 << "entries/min: " << stats.entries_per_minute() << "\n";
+      return os;
+    }
+
+    // This class pushes the uris of sitemaps to the frontier of the passed
+    // crawl_frontend. The frontier is a FIFO queue, so the initial schedule
+    // is set per batch: each batch is pushed in the order of descending
+    // <priority> and, for equal priorities, of the most recent <lastmod>.
+    template<typename Policy>
+    class sitemap_ingester {
+    public:
+      // This constructor takes the front end that receives all uris and the
+      // parameters of the ingester.
+      sitemap_ingester(crawler_pp::policies::crawl_frontend<Policy> &frontend,
+		       const sitemap_options &options = sitemap_options())
+	:frontend_(frontend), options_(options) {
+	this->batch_.reserve(options.batch_size);
+      }
+      // Ingests all entries of the passed sitemap or sitemap index file and
+      // of the sitemaps that are listed by an index. If a file cannot be read
+      // the crawler_pp::exceptions::sitemap_exception is thrown.
+      void ingest(const std::string &path){
+	const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+	try {
+	  this->ingest(path, 0);
+	  this->flush();
+	} catch(...) {
+	  this->stats_.elapsed += std::chrono::steady_clock::now() - start;
+	  throw;
+	}
+	this->stats_.elapsed += std::chrono::steady_clock::now() - start;
+      }
+      // A getter for the member stats_
+      const sitemap_stats& get_stats() const {
+	return this->stats_;
+      }
+    private:
+      // A normalized uri that waits for the next batch
+      struct pending_uri {
+	std::string value;
+	double priority;
+	std::chrono::system_clock::time_point lastmod;
+      };
+
+      // Reads a single file, depth is the number of enclosing indexes.
+      void ingest(const std::string &path, unsigned depth){
+	sitemap_reader reader(path);
+	sitemap_entry entry;
+	++this->stats_.sitemaps;
+	while(reader.next(entry)) {
+	  if(entry.is_sitemap) {
+	    const std::string child(depth < this->options_.max_depth ? this->options_.locate(entry.loc, path) : "");
+	    if(child.empty()) ++this->stats_.skipped;
+	    else this->ingest(child, depth + 1);
+	    continue;
+	  }
+	  ++this->stats_.entries;
+	  if(entry.priority < this->options_.min_priority ||
+	     (entry.lastmod != std::chrono::system_clock::time_point() &&
+	      entry.lastmod < this->options_.modified_since)) {
+	    ++this->stats_.skipped;
+	    continue;
+	  }
+	  pending_uri uri;
+	  try {
+	    uri.value = crawler_pp::policies::crawl_frontend<Policy>::normalize(entry.loc);
+	  } catch(crawler_pp::exceptions::uri_exception&) {
+	    ++this->stats_.rejected;
+	    continue;
+	  }
+	  uri.priority = entry.priority;
+	  uri.lastmod = entry.lastmod;
+	  this->batch_.push_back(std::move(uri));
+	  if(this->batch_.size() >= this->options_.batch_size) this->flush();
+	}
+	this->stats_.bytes += reader.get_offset();
+      }
+      // Pushes the pending uris to the frontier.
+      void flush(){
+	if(this->batch_.empty()) return;
+	std::stable_sort(this->batch_.begin(), this->batch_.end(),
+			 [](const pending_uri &lhs, const pending_uri &rhs){
+			   return lhs.priority != rhs.priority ? lhs.priority > rhs.priority : lhs.lastmod > rhs.lastmod;
+			 });
+	std::vector<std::string> values;
+	values.reserve(this->batch_.size());
+	for(size_t i(0); i != this->batch_.size(); ++i) values.push_back(std::move(this->batch_[i].value));
+	const size_t admitted(this->frontend_.admit_batch(std::move(values)));
+	this->stats_.admitted += admitted;
+	this->stats_.duplicates += this->batch_.size() - admitted;
+	this->batch_.clear();
+      }
+
+      crawler_pp::policies::crawl_frontend<Policy> &frontend_;
+      sitemap_options options_;
+      std::vector<pending_uri> batch_;
+      sitemap_stats stats_;
+    }; // end of class sitemap_ingester
+  } // end of namespace extraction
+} // end of namespace crawler_pp
+
+#endif // SITEMAP_INGESTER_H
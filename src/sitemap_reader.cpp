@@ -0,0 +1,337 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: sitemap_reader.cpp
+// Description: This implementation file implements the sitemap_reader class
+//              that reads sitemap and sitemap index files as a stream.
+// Public interfaces:
+//   * sitemap_entry
+//   * sitemap_reader
+//   * parse_w3c_datetime
+// ============================================================================
+
+
+#include "sitemap_reader.h"
+#include "exceptions.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+using std::string;
+using crawler_pp::exceptions::sitemap_exception;
+
+namespace {
+  // The size of the read buffer
+  const size_t BUFFER_SIZE(1 << 17);
+
+  bool is_space(int c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  // Appends the UTF-8 encoding of the passed code point.
+  void append_utf8(string &result, unsigned long code){
+    if(code < 0x80) {
+      result += static_cast<char>(code);
+    } else if(code < 0x800) {
+      result += static_cast<char>(0xc0 | (code >> 6));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    } else if(code < 0x10000) {
+      result += static_cast<char>(0xe0 | (code >> 12));
+      result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    } else if(code < 0x110000) {
+      result += static_cast<char>(0xf0 | (code >> 18));
+      result += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      result += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  // Reads count digits at pos of value into result and advances pos.
+  bool read_digits(const string &value, size_t &pos, size_t count, int &result){
+    if(value.size() < pos + count) return false;
+    result = 0;
+    for(size_t end(pos + count); pos != end; ++pos) {
+      if(value[pos] < '0' || value[pos] > '9') return false;
+      result = result * 10 + (value[pos] - '0');
+    }
+    return true;
+  }
+} // end of anonymous namespace
+
+// ============================================================================
+// === the sitemap_reader class ===============================================
+// ============================================================================
+
+// The protocol limits loc to 2048 characters
+const size_t crawler_pp::extraction::sitemap_reader::MAX_VALUE_SIZE(4096);
+
+crawler_pp::extraction::sitemap_reader::sitemap_reader(const string &path)
+  :path_(path), file_(nullptr), buffer_(BUFFER_SIZE), begin_(0), end_(0), offset_(0),
+   overflow_(false), field_(NONE) {
+  // gzread reads files that are not gzip compressed unchanged
+  this->file_ = gzopen(path.c_str(), "rb");
+  if(!this->file_) throw sitemap_exception(errno ? std::strerror(errno) : "Could not open file", path);
+  gzbuffer(this->file_, static_cast<unsigned>(BUFFER_SIZE));
+}
+
+bool crawler_pp::extraction::sitemap_reader::fill(){
+  const int size(gzread(this->file_, this->buffer_.data(), static_cast<unsigned>(this->buffer_.size())));
+  if(size < 0) {
+    int code;
+    const char *message(gzerror(this->file_, &code));
+    throw sitemap_exception(message ? message : "Could not read file", this->path_);
+  }
+  this->begin_ = 0;
+  this->end_ = size;
+  this->offset_ += size;
+  return size != 0;
+}
+
+int crawler_pp::extraction::sitemap_reader::get(){
+  if(this->begin_ == this->end_ && !this->fill()) return -1;
+  return static_cast<unsigned char>(this->buffer_[this->begin_++]);
+}
+
+void crawler_pp::extraction::sitemap_reader::append(const char *data, size_t size){
+  if(this->value_.size() + size > MAX_VALUE_SIZE) this->overflow_ = true;
+  else this->value_.append(data, size);
+}
+
+void crawler_pp::extraction::sitemap_reader::read_text(){
+  while(this->begin_ != this->end_ || this->fill()) {
+    const char *begin(this->buffer_.data() + this->begin_);
+    const char *tag(static_cast<const char*>(std::memchr(begin, '<', this->end_ - this->begin_)));
+    const size_t size(tag ? tag - begin : this->end_ - this->begin_);
+    if(this->field_ != NONE) this->append(begin, size);
+    this->begin_ += size;
+    if(tag) return;
+  }
+}
+
+void crawler_pp::extraction::sitemap_reader::skip_past(const char *terminator){
+  // The window holds the last characters read, the terminators are short
+  const size_t size(std::strlen(terminator));
+  string window;
+  for(int c; (c = this->get()) >= 0; ) {
+    window += static_cast<char>(c);
+    if(window.size() > size) window.erase(0, 1);
+    if(window == terminator) return;
+  }
+}
+
+bool crawler_pp::extraction::sitemap_reader::read_tag(bool &closing, bool &empty){
+  closing = empty = false;
+  int c(this->get());
+  if(c == '?') {
+    this->skip_past("?>");
+    return false;
+  }
+  if(c == '!') {
+    c = this->get();
+    if(c == '-') {
+      this->skip_past("-->");
+    } else if(c == '[') {
+      // "<![CDATA[...]]>", the content is read verbatim
+      for(int i(0); i != 6; ++i) this->get();
+      string window;
+      for(int next; (next = this->get()) >= 0; ) {
+	window += static_cast<char>(next);
+	if(window.size() > 3) {
+	  if(this->field_ != NONE) this->append(window.data(), 1);
+	  window.erase(0, 1);
+	}
+	if(window == "]]>") break;
+      }
+    } else {
+      this->skip_past(">");
+    }
+    return false;
+  }
+  if(c == '/') {
+    closing = true;
+    c = this->get();
+  }
+  this->name_.clear();
+  for(; c >= 0 && !is_space(c) && c != '/' && c != '>'; c = this->get()) {
+    // The namespace prefix is dropped, e.g. "image:loc"
+    if(c == ':') this->name_.clear();
+    else if(this->name_.size() < 32) this->name_ += static_cast<char>(c);
+  }
+  // Skips the attributes, a '>' may be part of a quoted value
+  char quote(0);
+  int last(0);
+  for(; c >= 0 && (quote || c != '>'); c = this->get()) {
+    if(quote) {
+      if(c == quote) quote = 0;
+    } else if(c == '"' || c == '\'') {
+      quote = static_cast<char>(c);
+    } else if(!is_space(c)) {
+      last = c;
+    }
+  }
+  empty = last == '/';
+  return true;
+}
+
+string crawler_pp::extraction::sitemap_reader::take_value(){
+  string result;
+  result.reserve(this->value_.size());
+  const string &value(this->value_);
+  for(size_t i(0); i < value.size(); ++i) {
+    if(value[i] != '&') {
+      result += value[i];
+      continue;
+    }
+    const size_t end(value.find(';', i));
+    if(end == string::npos || end - i > 10) {
+      result += value[i];
+      continue;
+    }
+    const string entity(value.substr(i + 1, end - i - 1));
+    if(entity == "amp") result += '&';
+    else if(entity == "lt") result += '<';
+    else if(entity == "gt") result += '>';
+    else if(entity == "quot") result += '"';
+    else if(entity == "apos") result += '\'';
+    else if(entity.size() > 1 && entity[0] == '#')
+      append_utf8(result, entity[1] == 'x' || entity[1] == 'X' ?
+		  std::strtoul(entity.c_str() + 2, nullptr, 16) : std::strtoul(entity.c_str() + 1, nullptr, 10));
+    else {
+      result += value[i];
+      continue;
+    }
+    i = end;
+  }
+  const size_t begin(result.find_first_not_of(" \t\r\n"));
+  if(begin == string::npos) return "";
+  return result.substr(begin, result.find_last_not_of(" \t\r\n") + 1 - begin);
+}
+
+bool crawler_pp::extraction::sitemap_reader::next(crawler_pp::extraction::sitemap_entry &entry){
+  bool in_entry(false), valid(true);
+  bool closing, empty;
+  // The number of open elements within the current entry, the fields are
+  // its direct children only, e.g. not the loc of "<image:image>"
+  size_t depth(0);
+  while(true) {
+    this->read_text();
+    if(this->get() < 0) return false;
+    if(!this->read_tag(closing, empty)) continue;
+    const bool is_entry(!depth && (this->name_ == "url" || this->name_ == "sitemap"));
+    if(!closing) {
+      if(is_entry) {
+	in_entry = !empty;
+	valid = true;
+	entry = crawler_pp::extraction::sitemap_entry();
+	entry.is_sitemap = this->name_ == "sitemap";
+      } else if(in_entry) {
+	if(!depth && this->field_ == NONE) {
+	  if(this->name_ == "loc") this->field_ = LOC;
+	  else if(this->name_ == "lastmod") this->field_ = LASTMOD;
+	  else if(this->name_ == "priority") this->field_ = PRIORITY;
+	  this->value_.clear();
+	  this->overflow_ = false;
+	}
+	if(!empty) ++depth;
+      }
+      if(!empty) continue;
+    }
+    if(!in_entry) continue;
+    if(is_entry) {
+      in_entry = false;
+      this->field_ = NONE;
+      if(valid && !entry.loc.empty()) return true;
+      continue;
+    }
+    if(closing && depth) --depth;
+    if(depth) continue;
+    if((this->field_ == LOC && this->name_ == "loc") ||
+       (this->field_ == LASTMOD && this->name_ == "lastmod") ||
+       (this->field_ == PRIORITY && this->name_ == "priority")) {
+      const field current(this->field_);
+      this->field_ = NONE;
+      if(this->overflow_) {
+	valid = false;
+	continue;
+      }
+      const string value(this->take_value());
+      if(current == LOC) {
+	entry.loc = value;
+      } else if(current == LASTMOD) {
+	if(!parse_w3c_datetime(value, entry.lastmod))
+	  entry.lastmod = std::chrono::system_clock::time_point();
+      } else {
+	char *end;
+	const double priority(std::strtod(value.c_str(), &end));
+	if(!value.empty() && !*end && priority >= 0 && priority <= 1) entry.priority = priority;
+      }
+    }
+  }
+}
+
+uint64_t crawler_pp::extraction::sitemap_reader::get_offset() const {
+  return this->offset_;
+}
+
+crawler_pp::extraction::sitemap_reader::~sitemap_reader(){
+  gzclose(this->file_);
+}
+
+// ============================================================================
+// === parse_w3c_datetime =====================================================
+// ============================================================================
+
+bool crawler_pp::extraction::parse_w3c_datetime(const string &value,
+						std::chrono::system_clock::time_point &result){
+  std::tm date;
+  std::memset(&date, 0, sizeof(date));
+  date.tm_mday = 1;
+  size_t pos(0);
+  int year, offset(0);
+  if(!read_digits(value, pos, 4, year)) return false;
+  date.tm_year = year - 1900;
+  // YYYY-MM
+  if(pos != value.size()) {
+    if(value[pos++] != '-' || !read_digits(value, pos, 2, date.tm_mon) || date.tm_mon < 1 || date.tm_mon > 12)
+      return false;
+    --date.tm_mon;
+  }
+  // YYYY-MM-DD
+  if(pos != value.size()) {
+    if(value[pos++] != '-' || !read_digits(value, pos, 2, date.tm_mday) || date.tm_mday < 1 || date.tm_mday > 31)
+      return false;
+  }
+  // YYYY-MM-DDThh:mm[:ss[.s]]TZD
+  if(pos != value.size()) {
+    if(value[pos++] != 'T' || !read_digits(value, pos, 2, date.tm_hour) || pos == value.size() ||
+       value[pos++] != ':' || !read_digits(value, pos, 2, date.tm_min))
+      return false;
+    if(pos != value.size() && value[pos] == ':') {
+      ++pos;
+      if(!read_digits(value, pos, 2, date.tm_sec)) return false;
+      if(pos != value.size() && value[pos] == '.') {
+	++pos;
+	while(pos != value.size() && value[pos] >= '0' && value[pos] <= '9') ++pos;
+      }
+    }
+    if(pos == value.size()) return false;
+    if(value[pos] == 'Z') {
+      ++pos;
+    } else if(value[pos] == '+' || value[pos] == '-') {
+      const int sign(value[pos++] == '-' ? -1 : 1);
+      int hours, minutes;
+      if(!read_digits(value, pos, 2, hours) || pos == value.size() || value[pos++] != ':' ||
+	 !read_digits(value, pos, 2, minutes))
+	return false;
+      offset = sign * (hours * 3600 + minutes * 60);
+    } else {
+      return false;
+    }
+    if(date.tm_hour > 23 || date.tm_min > 59 || date.tm_sec > 60) return false;
+  }
+  if(pos != value.size()) return false;
+  result = std::chrono::system_clock::from_time_t(timegm(&date) - offset);
+  return true;
+}
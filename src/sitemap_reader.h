@@ -0,0 +1,105 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: sitemap_reader.h
+// Description: This header file defines the sitemap_reader class that reads
+//              the entries of sitemap and sitemap index files (see
+//              https://www.sitemaps.org/protocol.html) as a stream. Plain and
+//              gzip compressed files are read through a fixed buffer, i.e.
+//              the memory usage does not depend on the size of the file.
+// Public interfaces:
+//   * sitemap_entry
+//   * sitemap_reader
+//   * parse_w3c_datetime
+// ============================================================================
+
+
+#ifndef SITEMAP_READER_H
+#define SITEMAP_READER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace crawler_pp {
+  namespace extraction {
+
+    // A single <url> entry of a sitemap or <sitemap> entry of a sitemap
+    // index.
+    struct sitemap_entry {
+      // The value of <loc>
+      std::string loc;
+      // The value of <lastmod>, the epoch if the entry has no valid lastmod
+      std::chrono::system_clock::time_point lastmod;
+      // The value of <priority>, 0.5 if the entry has no valid priority
+      double priority = 0.5;
+      // True for a <sitemap> entry of a sitemap index
+      bool is_sitemap = false;
+    }; // end of struct sitemap_entry
+
+    // This class reads all entries of a sitemap or a sitemap index one after
+    // the other. Only the elements loc, lastmod and priority are evaluated,
+    // namespace prefixes are ignored.
+    class sitemap_reader {
+    public:
+      // The maximum length of an element value, longer entries are skipped
+      static const size_t MAX_VALUE_SIZE;
+      // This constructor opens the (optionally gzip compressed) sitemap with
+      // the passed path. If the file cannot be read the
+      // crawler_pp::exceptions::sitemap_exception is thrown.
+      sitemap_reader(const std::string&);
+      // A sitemap_reader cannot be copied, since it owns the open file.
+      sitemap_reader(const sitemap_reader&) = delete;
+      sitemap_reader& operator=(const sitemap_reader&) = delete;
+      // Reads the next entry into the passed sitemap_entry. Returns false if
+      // the end of the file is reached. If the file cannot be read the
+      // crawler_pp::exceptions::sitemap_exception is thrown.
+      bool next(sitemap_entry&);
+      // Returns the number of (uncompressed) bytes read so far.
+      uint64_t get_offset() const;
+      // The destructor closes the file.
+      ~sitemap_reader();
+    private:
+      // The elements whose values are read
+      enum field { NONE, LOC, LASTMOD, PRIORITY };
+
+      // Returns the next character or -1 at the end of the file.
+      int get();
+      // Refills the buffer, returns false at the end of the file.
+      bool fill();
+      // Skips all characters up to and including the passed terminator.
+      void skip_past(const char*);
+      // Appends the characters up to the next '<' to value_ if a field is
+      // read, otherwise they are skipped.
+      void read_text();
+      // Reads the markup after a '<'. Returns false for comments and other
+      // markup that is no element, otherwise the (local) name of the element
+      // is stored in name_.
+      bool read_tag(bool &closing, bool &empty);
+      // Appends the passed characters to value_ unless it is too long.
+      void append(const char*, size_t);
+      // Decodes the character references of value_ and trims white space.
+      std::string take_value();
+
+      std::string path_;
+      gzFile file_;
+      std::vector<char> buffer_;
+      size_t begin_;
+      size_t end_;
+      uint64_t offset_;
+      std::string name_;
+      std::string value_;
+      bool overflow_;
+      field field_;
+    }; // end of class sitemap_reader
+
+    // Parses a W3C datetime (https://www.w3.org/TR/NOTE-datetime), e.g.
+    // "2014-09-30" or "2014-09-30T12:00:00+02:00", into the passed time
+    // point. Returns false if the value is malformed.
+    bool parse_w3c_datetime(const std::string&, std::chrono::system_clock::time_point&);
+  } // end of namespace extraction
+} // end of namespace crawler_pp
+
+#endif // SITEMAP_READER_H
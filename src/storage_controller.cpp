@@ -1 +1,210 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: storage_controller.cpp
+// Description: This implementation file implements the storage_controller
+//              class that stores fetched pages in WARC files.
+// Public interfaces:
+//   * storage_options
+//   * fetch_record
+//   * storage_controller
+//   * async_store
+// ============================================================================
+
+
 #include "storage_controller.h"
+
+#include <utility>
+
+using crawler_pp::storage::fetch_record;
+
+crawler_pp::storage::storage_controller::storage_controller(const crawler_pp::storage::storage_options &options)
+  :writer_(options.writer), queue_(options.queue_capacity), queued_(0), written_(0), flushed_(0),
+   stopped_(false), waiting_producers_(0), sleeping_(false) {
+  this->thread_ = std::thread(&crawler_pp::storage::storage_controller::run, this);
+}
+
+void crawler_pp::storage::storage_controller::store(fetch_record &&record){
+  if(this->enqueue(record, false)) return;
+  std::unique_lock<std::mutex> lock(this->wait_mutex_);
+  ++this->waiting_producers_;
+  // The writer thread sees waiting_producers_ after it took a record or
+  // the retry sees the free space
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while(!this->enqueue(record, true)) this->space_cv_.wait(lock);
+  --this->waiting_producers_;
+}
+
+bool crawler_pp::storage::storage_controller::try_store(fetch_record &record){
+  return this->enqueue(record, false);
+}
+
+bool crawler_pp::storage::storage_controller::try_store(fetch_record &record, std::function<void()> callback){
+  if(this->enqueue(record, false)) return true;
+  std::lock_guard<std::mutex> lock(this->wait_mutex_);
+  ++this->waiting_producers_;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(this->enqueue(record, true)) {
+    --this->waiting_producers_;
+    return true;
+  }
+  this->space_callbacks_.push_back(std::move(callback));
+  return false;
+}
+
+bool crawler_pp::storage::storage_controller::enqueue(fetch_record &record, bool locked){
+  // queued_ is incremented first, so flush never misses a record and the
+  // writer thread does not fall asleep while the record is pushed
+  ++this->queued_;
+  if(!this->queue_.try_push(record)) {
+    --this->queued_;
+    return false;
+  }
+  if(this->sleeping_.load()) {
+    if(locked) {
+      this->queued_cv_.notify_one();
+    } else {
+      std::lock_guard<std::mutex> lock(this->wait_mutex_);
+      this->queued_cv_.notify_one();
+    }
+  }
+  return true;
+}
+
+void crawler_pp::storage::storage_controller::notify_producers(){
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(!this->waiting_producers_.load()) return;
+  std::vector<std::function<void()> > callbacks;
+  {
+    std::lock_guard<std::mutex> lock(this->wait_mutex_);
+    callbacks.swap(this->space_callbacks_);
+    this->waiting_producers_ -= static_cast<unsigned>(callbacks.size());
+    this->space_cv_.notify_all();
+  }
+  for(size_t i(0); i != callbacks.size(); ++i) callbacks[i]();
+}
+
+void crawler_pp::storage::storage_controller::flush(){
+  const uint64_t target(this->queued_.load());
+  {
+    std::unique_lock<std::mutex> lock(this->wait_mutex_);
+    this->flushed_cv_.wait(lock, [this, target]{ return this->flushed_.load() >= target; });
+  }
+  std::lock_guard<std::mutex> lock(this->error_mutex_);
+  if(this->error_) {
+    std::exception_ptr error(this->error_);
+    this->error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+uint64_t crawler_pp::storage::storage_controller::get_written() const {
+  return this->written_.load();
+}
+
+void crawler_pp::storage::storage_controller::write(fetch_record &record){
+  crawler_pp::warc::warc_record_header request;
+  request.record_id = crawler_pp::warc::warc_writer::make_record_id();
+  crawler_pp::warc::warc_record_header response;
+  response.type = "response";
+  response.target_uri = record.target_uri;
+  response.date = record.date;
+  response.record_id = crawler_pp::warc::warc_writer::make_record_id();
+  response.content_type = "application/http; msgtype=response";
+  if(!record.request.empty())
+    response.headers.push_back(std::make_pair("WARC-Concurrent-To", request.record_id));
+  const crawler_pp::warc::record_location location(this->writer_.write_record(response,
+									     record.response_length,
+									     record.response));
+  this->writer_.write_index(location, record.target_uri, record.date, record.mime, record.status);
+
+  if(record.request.empty()) return;
+  request.type = "request";
+  request.target_uri = record.target_uri;
+  request.date = record.date;
+  request.content_type = "application/http; msgtype=request";
+  request.headers.push_back(std::make_pair("WARC-Concurrent-To", response.record_id));
+  const uint64_t length(record.request.size());
+  this->writer_.write_record(request, length, crawler_pp::warc::string_source(std::move(record.request)),
+			     false);
+}
+
+void crawler_pp::storage::storage_controller::run(){
+  fetch_record record;
+  while(true) {
+    if(this->queue_.try_pop(record)) {
+      this->notify_producers();
+      try {
+	this->write(record);
+      } catch(...) {
+	std::lock_guard<std::mutex> lock(this->error_mutex_);
+	if(!this->error_) this->error_ = std::current_exception();
+      }
+      record = fetch_record();
+      ++this->written_;
+      continue;
+    }
+    // The queue is empty: make the written records visible to readers
+    const uint64_t written(this->written_.load());
+    if(this->flushed_.load() != written) {
+      try {
+	this->writer_.flush();
+      } catch(...) {
+	// e.g. a full disk, it is rethrown by flush
+	std::lock_guard<std::mutex> lock(this->error_mutex_);
+	if(!this->error_) this->error_ = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(this->wait_mutex_);
+      this->flushed_.store(written);
+      this->flushed_cv_.notify_all();
+    }
+    if(this->stopped_.load() && written == this->queued_.load()) break;
+    // Sleeps until a record is queued, a producer that increments queued_
+    // before sleeping_ is set wakes the thread by the predicate instead
+    std::unique_lock<std::mutex> lock(this->wait_mutex_);
+    this->sleeping_.store(true);
+    this->queued_cv_.wait(lock, [this, written]{ return this->stopped_.load() || this->queued_.load() != written; });
+    this->sleeping_.store(false);
+  }
+}
+
+crawler_pp::storage::storage_controller::~storage_controller(){
+  {
+    std::lock_guard<std::mutex> lock(this->wait_mutex_);
+    this->stopped_.store(true);
+  }
+  this->queued_cv_.notify_one();
+  this->thread_.join();
+}
+
+#if __cplusplus >= 202002L
+namespace {
+  // The awaitable of async_store, it suspends the awaiting coroutine while
+  // the queue is full. The writer thread posts it to its event loop as soon
+  // as there is space.
+  struct store_awaiter {
+    bool await_ready() const noexcept {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> handle){
+      crawler_pp::async::event_loop *loop(crawler_pp::async::event_loop::current());
+      this->stored = this->controller.try_store(this->record, [handle, loop](){ loop->post(handle); });
+      return !this->stored;
+    }
+    bool await_resume() const noexcept {
+      return this->stored;
+    }
+
+    crawler_pp::storage::storage_controller &controller;
+    fetch_record &record;
+    bool stored;
+  }; // end of struct store_awaiter
+} // end of anonymous namespace
+
+crawler_pp::async::task<void> crawler_pp::storage::async_store(crawler_pp::storage::storage_controller &controller,
+							       fetch_record record){
+  // The co_await is kept out of the loop condition, g++ 12 miscompiles a
+  // co_await in the condition of a while loop
+  bool stored(false);
+  while(!stored) stored = co_await store_awaiter{controller, record, false};
+}
+#endif
@@ -1,4 +1,149 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: storage_controller.h
+// Description: This header file defines the storage_controller class that
+//              stores fetched pages as request and response records in WARC
+//              files. The records are passed by the download workers through
+//              a lock-free queue to a dedicated writer thread. The writer
+//              thread sleeps while the queue is empty and producers sleep
+//              while it is full, both are woken by condition variables.
+// Public interfaces:
+//   * storage_options
+//   * fetch_record
+//   * storage_controller
+//   * async_store
+// ============================================================================
+
+
 #ifndef STORAGE_CONTROLLER_H
 #define STORAGE_CONTROLLER_H
 
+#include "bounded_queue.h"
+#include "warc_writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __cplusplus >= 202002L
+  #include "event_loop.h"
+#endif
+
+namespace crawler_pp {
+  namespace storage {
+
+    // Bundles all parameters of a storage_controller.
+    struct storage_options {
+      // The parameters of the WARC files
+      crawler_pp::warc::warc_writer_options writer;
+      // The number of records that may wait for the writer thread
+      size_t queue_capacity = 1024;
+    }; // end of struct storage_options
+
+    // A fetched page that is stored as a request and a response record.
+    struct fetch_record {
+      // The requested uri
+      std::string target_uri;
+      // The time the page was requested
+      std::chrono::system_clock::time_point date;
+      // The HTTP request message; no request record is written if empty
+      std::string request;
+      // The size of the HTTP response message in bytes
+      uint64_t response_length = 0;
+      // The HTTP response message (status line, headers and body), it is
+      // read by the writer thread
+      crawler_pp::warc::content_source response;
+      // The HTTP status code of the response
+      int status = 0;
+      // The value of the Content-Type header of the response
+      std::string mime;
+    }; // end of struct fetch_record
+
+    // This class writes fetch_records to WARC files by a dedicated thread.
+    // The methods store, try_store and flush are thread safe.
+    class storage_controller {
+    public:
+      // This constructor takes the parameters of the controller and starts
+      // the writer thread.
+      storage_controller(const storage_options&);
+      // A storage_controller cannot be copied, since it owns a thread.
+      storage_controller(const storage_controller&) = delete;
+      storage_controller& operator=(const storage_controller&) = delete;
+      // Passes the record to the writer thread, blocks while the queue is
+      // full.
+      void store(fetch_record&&);
+      // Passes the record to the writer thread. Returns false if the queue
+      // is full, the record is not moved then.
+      bool try_store(fetch_record&);
+      // Passes the record to the writer thread. Returns false if the queue
+      // is full, the record is not moved then and the passed function is
+      // called once by the writer thread as soon as it took a record from
+      // the queue.
+      bool try_store(fetch_record&, std::function<void()>);
+      // Blocks until all records that were stored before are written and
+      // flushed. If a record could not be written or flushed, the first
+      // error is rethrown (crawler_pp::exceptions::warc_exception).
+      void flush();
+      // Returns the number of records that were passed to the writer.
+      uint64_t get_written() const;
+      // The destructor writes all queued records and stops the writer
+      // thread.
+      ~storage_controller();
+    private:
+      // The function of the writer thread
+      void run();
+      // Writes the request and the response record of the passed record.
+      void write(fetch_record&);
+      // Pushes the passed record to the queue and wakes the sleeping writer
+      // thread. The second parameter is true if the caller holds
+      // wait_mutex_. Returns false if the queue is full.
+      bool enqueue(fetch_record&, bool);
+      // Wakes the producers that wait for space in the queue, it is called
+      // by the writer thread after each record taken from the queue.
+      void notify_producers();
+
+      crawler_pp::warc::warc_writer writer_;
+      crawler_pp::utils::bounded_queue<fetch_record> queue_;
+      std::atomic<uint64_t> queued_;
+      std::atomic<uint64_t> written_;
+      std::atomic<uint64_t> flushed_;
+      std::atomic<bool> stopped_;
+      // Guards the waiting of the writer thread, of store and of flush
+      std::mutex wait_mutex_;
+      // Signals a queued record or the stop to the sleeping writer thread
+      std::condition_variable queued_cv_;
+      // Signals space in the queue to the blocked store calls
+      std::condition_variable space_cv_;
+      // Signals a flush of the writer
+      std::condition_variable flushed_cv_;
+      // The functions of the try_store calls that wait for space
+      std::vector<std::function<void()> > space_callbacks_;
+      // The number of store calls and functions that wait for space, the
+      // writer thread takes wait_mutex_ only if a producer waits
+      std::atomic<unsigned> waiting_producers_;
+      // True while the writer thread waits for a record, a producer takes
+      // wait_mutex_ only if the writer thread sleeps
+      std::atomic<bool> sleeping_;
+      std::mutex error_mutex_;
+      std::exception_ptr error_;
+      std::thread thread_;
+    }; // end of class storage_controller
+
+#if __cplusplus >= 202002L
+    // Passes the record to the writer thread of the passed controller. While
+    // the queue is full the awaiting coroutine is suspended instead of
+    // blocking the thread of its event loop, the writer thread posts it back
+    // to its loop as soon as there is space.
+    crawler_pp::async::task<void> async_store(storage_controller&, fetch_record);
+#endif
+  } // end of namespace storage
+} // end of namespace crawler_pp
+
 #endif // STORAGE_CONTROLLER_H
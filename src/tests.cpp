@@ -8,13 +8,45 @@
 
 #include "odb/uri.odb.h"
 #include "uri.h"
+#include "crawl_frontend.h"
+#include "visited_set.h"
+#include "scheduler.h"
+#include "warc_replay.h"
+#include "storage_controller.h"
+#include "sitemap_ingester.h"
+#include "crawl_pipeline.h"
+#include "url_analyzer.h"
+#include "database.h"
 
 #include <odb/database.hxx>
 #include <odb/transaction.hxx>
 #include <odb/pgsql/database.hxx>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #include "exceptions.h" // TOOD: remove
 
@@ -22,6 +54,208 @@ using std::cout;
 using std::endl;
 using std::string;
 
+// A crawl policy that keeps the frontier and the visited uris in memory
+typedef crawler_pp::policies::crawl_policy<
+  crawler_pp::policies::http_schemes,
+  crawler_pp::policies::fixed_max_size<64>,
+  crawler_pp::policies::normalization<network::uri_comparison_level::syntax_based>,
+  crawler_pp::policies::memory_frontier,
+  crawler_pp::policies::memory_dedup> test_policy;
+
+// The test policy that filters crawler traps and strips parameters
+typedef crawler_pp::policies::crawl_policy<
+  crawler_pp::policies::http_schemes,
+  crawler_pp::policies::fixed_max_size<64>,
+  crawler_pp::policies::normalization<network::uri_comparison_level::syntax_based>,
+  crawler_pp::policies::memory_frontier,
+  crawler_pp::policies::memory_dedup,
+  crawler_pp::policies::url_analyzer> analyzer_policy;
+
+// Simulates a host that serves capacity requests in parallel within base
+// milliseconds, further requests are queued (i.e. the latency grows) and
+// more than three times capacity requests are rejected with 503. Returns the
+// average concurrency limit of the second half of the simulated time.
+double simulate_host(size_t capacity, int base, int seconds){
+  typedef crawler_pp::scheduling::host_controller::clock clock;
+  crawler_pp::scheduling::host_controller controller((crawler_pp::scheduling::controller_options()));
+  std::vector<std::pair<clock::time_point, crawler_pp::download::download_result> > in_flight;
+  clock::time_point now(clock::time_point() + std::chrono::hours(1));
+  double limit(0);
+  for(int t(0); t != seconds * 1000; ++t){
+    now += std::chrono::milliseconds(1);
+    for(size_t i(0); i != in_flight.size();){
+      if(in_flight[i].first > now){
+	++i;
+	continue;
+      }
+      controller.release(in_flight[i].second, now);
+      in_flight.erase(in_flight.begin() + i);
+    }
+    while(controller.try_acquire(now)){
+      const size_t requests(in_flight.size() + 1);
+      crawler_pp::download::download_result result;
+      result.status = requests > 3 * capacity ? 503 : 200;
+      result.latency = std::chrono::milliseconds(base * ((requests + capacity - 1) / capacity));
+      result.retry_after = std::chrono::seconds(0);
+      in_flight.push_back(std::make_pair(now + result.latency, result));
+    }
+    if(t >= seconds * 500) limit += controller.get_metrics(now).concurrency_limit;
+  }
+  return limit / (seconds * 500);
+}
+
+// Returns a WARC response record for the passed uri and HTML body.
+string warc_response(const string &uri, const string &html,
+		     const string &headers = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"){
+  const string http(headers + "\r\n" + html);
+  return "WARC/1.0\r\nWARC-Type: response\r\nWARC-Target-URI: " + uri +
+    "\r\nContent-Type: application/http; msgtype=response\r\nContent-Length: " +
+    std::to_string(http.size()) + "\r\n\r\n" + http + "\r\n\r\n";
+}
+
+// Answers count requests on the passed listening socket, one connection
+// after the other: "/" and "/a" link to the other pages, "/b" is sent with
+// the chunked transfer coding, "/c" and "/f" are malformed and all other
+// paths are not found.
+void serve_pages(int listener, size_t count){
+  for(size_t i(0); i != count; ++i) {
+    const int client(accept(listener, nullptr, nullptr));
+    if(client < 0) return;
+    string request;
+    char buffer[1024];
+    for(ssize_t size; request.find("\r\n\r\n") == string::npos && (size = recv(client, buffer, sizeof(buffer), 0)) > 0; )
+      request.append(buffer, size);
+    const string path(request.substr(4, request.find(' ', 4) - 4));
+    string response;
+    if(path == "/" || path == "/a") {
+      const string html(path == "/" ? "<a href=\"/a\">a</a><a href=\"b\">b</a>" : "<a href=\"/\">/</a><a href=\"/b\">b</a><a href=\"/f\">f</a>");
+      response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " + std::to_string(html.size()) +
+	"\r\n\r\n" + html;
+    } else if(path == "/b") {
+      // The first part ends with the data of a chunk that looks like the
+      // last chunk, the second part has a trailer
+      const string first("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nTransfer-Encoding: chunked\r\n\r\n"
+			 "a\r\n<a href=\"/\r\nd\r\nc\">c</a>0\r\n\r\n");
+      if(send(client, first.data(), first.size(), MSG_NOSIGNAL) < 0) {}
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      response = "\r\n12\r\n<a href=\"/e\">e</a>\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    } else if(path == "/c") {
+      // A Content-Length that does not fit into 64 bits fails the request
+      response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 99999999999999999999999\r\n\r\n"
+	"<a href=\"/d\">d</a>";
+    } else if(path == "/f") {
+      // The connection is closed before the body of the Content-Length was
+      // sent, so the request fails
+      response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 100\r\n\r\n"
+	"<a href=\"/g\">g</a>";
+    } else {
+      response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+    if(send(client, response.data(), response.size(), MSG_NOSIGNAL) < 0) {}
+    close(client);
+  }
+}
+
+// Binds a listening socket to a free port of the loopback interface and
+// returns it, root is set to the uri of its root path.
+int listen_loopback(string &root){
+  const int listener(socket(AF_INET, SOCK_STREAM, 0));
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length(sizeof(address));
+  const int bound(bind(listener, reinterpret_cast<sockaddr*>(&address), length));
+  const int listening(listen(listener, 128));
+  assert(!bound && !listening);
+  getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+  root = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/";
+  return listener;
+}
+
+// Answers the requests on the passed listening socket like the host of
+// simulate_host until stopped is set: capacity requests are served in
+// parallel within base milliseconds, the latency of further requests grows
+// and more than three times capacity requests are rejected with 503. The
+// responses are delayed by a single thread.
+void serve_host(int listener, size_t capacity, int base, const std::atomic<bool> &stopped){
+  typedef std::chrono::steady_clock clock;
+  // The accepted connections and the time of their response
+  std::vector<std::pair<clock::time_point, int> > pending;
+  const string ok("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nok");
+  const string unavailable("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n");
+  while(!stopped.load()) {
+    pollfd target{listener, POLLIN, 0};
+    if(poll(&target, 1, 5) > 0) {
+      const int client(accept(listener, nullptr, nullptr));
+      if(client < 0) continue;
+      // The crawler sends its request right after the connect
+      const timeval timeout{1, 0};
+      setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      string request;
+      char buffer[1024];
+      for(ssize_t size; request.find("\r\n\r\n") == string::npos && (size = recv(client, buffer, sizeof(buffer), 0)) > 0; )
+	request.append(buffer, size);
+      const size_t requests(pending.size() + 1);
+      if(requests > 3 * capacity) {
+	if(send(client, unavailable.data(), unavailable.size(), MSG_NOSIGNAL) < 0) {}
+	close(client);
+      } else {
+	pending.push_back(std::make_pair(clock::now() + std::chrono::milliseconds(base * ((requests + capacity - 1) / capacity)),
+					 client));
+      }
+    }
+    const clock::time_point now(clock::now());
+    for(size_t i(0); i != pending.size();) {
+      if(pending[i].first > now) {
+	++i;
+	continue;
+      }
+      if(send(pending[i].second, ok.data(), ok.size(), MSG_NOSIGNAL) < 0) {}
+      close(pending[i].second);
+      pending.erase(pending.begin() + i);
+    }
+  }
+  for(size_t i(0); i != pending.size(); ++i) close(pending[i].second);
+}
+
+// Fetches pages of a serve_host server by a crawl_pipeline, i.e. the
+// scheduler adapts to real sockets instead of simulated latencies. The
+// server is stopped as soon as the pipeline is done, a fetch that cannot
+// connect ends by its timeout. Returns the metrics of the host.
+crawler_pp::scheduling::host_metrics crawl_host(size_t capacity, int base, size_t fetches){
+  string root;
+  const int listener(listen_loopback(root));
+  std::atomic<bool> stopped(false);
+  std::thread server(serve_host, listener, capacity, base, std::cref(stopped));
+
+  crawler_pp::scheduling::controller_options controller;
+  controller.initial_delay = std::chrono::milliseconds(0);
+  crawler_pp::scheduling::scheduler scheduler(controller);
+  crawler_pp::resolving::address_resolver resolver;
+  crawler_pp::scheduling::pipeline_options options;
+  options.threads = 2;
+  options.max_in_flight = 128;
+  options.max_fetches = fetches;
+  options.timeout = std::chrono::milliseconds(5000);
+  size_t next(0);
+  crawler_pp::scheduling::crawl_pipeline pipeline(options, scheduler, resolver, nullptr,
+    [&root, &next](string &uri){
+      uri = root + std::to_string(next++);
+      return true;
+    },
+    [](const string&, int, uint64_t, std::vector<string>&){});
+  pipeline.run();
+  stopped.store(true);
+  server.join();
+  close(listener);
+  const size_t started(pipeline.get_stats().started);
+  assert(started == fetches);
+  const std::vector<std::pair<string, crawler_pp::scheduling::host_metrics> > metrics(scheduler.get_metrics());
+  assert(metrics.size() == 1);
+  return metrics[0].second;
+}
+
 int main(){
   cout << "entering tests.main" << endl;
   cout << "===============================================================================" << endl;
@@ -70,8 +304,529 @@ int main(){
     crawler_pp::data::waiting_uri uri("http://www.sueddEutsche.de:/any/../pAth#fragment?");
     cout << "8: _" << uri << "_" << endl;
   }
+  {
+    crawler_pp::policies::crawl_frontend<test_policy> frontend;
+    const bool admitted(frontend.admit("http://www.sueddEutsche.de/any/../pAth"));
+    const bool readmitted(frontend.admit("http://www.sueddEutsche.de/any/../pAth"));
+    assert(admitted && !readmitted);
+    crawler_pp::data::waiting_uri next(frontend.get_next());
+    assert(!frontend.has_next());
+    const bool marked(frontend.mark_visited(next));
+    const bool revisited(frontend.admit("http://www.sueddEutsche.de/any/../pAth"));
+    assert(marked && !revisited);
+    cout << "9: _" << next << "_" << endl;
+    try{
+      frontend.admit("http://www.sueddeutsche.de/" + string(64, 'a'));
+      assert(false);
+    }catch(crawler_pp::exceptions::uri_exception &err){
+      cout << "10: _" << "invalid: " << err.get_message() << "_" << endl;
+    }
+  }
+  {
+    crawler_pp::data::visited_set::options options;
+    options.directory = "./test/visited_set";
+    options.memtable_size = 2;
+    std::system("rm -rf ./test/visited_set && mkdir -p ./test/visited_set");
+    crawler_pp::data::visited_set::attach(std::make_shared<crawler_pp::data::visited_set>(options));
+    crawler_pp::data::visited_uri uri_1("http://www.sueddeutsche.de");
+    crawler_pp::data::visited_uri uri_2("https://www.sueddeutsche.de");
+    crawler_pp::data::visited_uri uri_3("http://www.sueddeutsche.de/any/path");
+    const bool stored_1(uri_1.persist());
+    const bool stored_2(uri_2.persist());
+    const bool stored_3(uri_3.persist());
+    const bool restored(uri_2.persist());
+    assert(stored_1 && stored_2 && stored_3 && !restored);
+    crawler_pp::data::visited_set::get_attached()->compact();
+    assert(crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>(uri_1));
+    assert(crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>("http://www.sueddeutsche.de/any/path"));
+    assert(!crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>("http://www.sueddeutsche.de/other"));
+    cout << "11: _" << crawler_pp::data::visited_set::get_attached()->run_count() << " run(s)_" << endl;
+    crawler_pp::data::visited_set::attach(nullptr);
+  }
+  {
+    const double fragile(simulate_host(1, 50, 60));
+    const double small(simulate_host(4, 50, 60));
+    const double big(simulate_host(16, 50, 60));
+    const double cdn(simulate_host(64, 50, 60));
+    assert(fragile < 2.5);
+    assert(small >= 2 && small <= 8);
+    assert(big >= 8 && big <= 32);
+    assert(cdn > big);
+    // A smoke test of the same controller against loopback servers, the
+    // limits depend on the timing of the machine, so only their bounds are
+    // checked
+    const crawler_pp::scheduling::host_metrics real_fragile(crawl_host(1, 20, 100));
+    const crawler_pp::scheduling::host_metrics real_big(crawl_host(16, 20, 400));
+    assert(real_fragile.requests == 100 && !real_fragile.in_flight);
+    assert(real_big.requests == 400 && !real_big.in_flight);
+    assert(real_fragile.concurrency_limit >= 1 && real_fragile.concurrency_limit <= 64);
+    assert(real_big.concurrency_limit >= 1 && real_big.concurrency_limit <= 64);
+    cout << "12: _" << fragile << " " << small << " " << big << " " << cdn << " (loopback: "
+	 << real_fragile.concurrency_limit << " " << real_big.concurrency_limit << ")_" << endl;
+  }
+  {
+    typedef crawler_pp::scheduling::scheduler::clock clock;
+    crawler_pp::scheduling::scheduler scheduler;
+    crawler_pp::data::waiting_uri uri("http://www.sueddeutsche.de/any/path");
+    clock::time_point now(clock::now());
+    const bool acquired(scheduler.try_acquire(uri, now));
+    assert(acquired);
+    crawler_pp::download::download_result result;
+    result.status = 429;
+    result.latency = std::chrono::milliseconds(20);
+    result.retry_after = crawler_pp::download::parse_retry_after("120", std::chrono::system_clock::now());
+    assert(result.retry_after == std::chrono::seconds(120));
+    scheduler.release(uri, result, now);
+    const bool early(scheduler.try_acquire(uri, now + std::chrono::seconds(119)));
+    const bool due(scheduler.try_acquire(uri, now + std::chrono::seconds(120)));
+    assert(!early && due);
+    assert(crawler_pp::download::parse_retry_after("Sun, 06 Nov 1994 08:49:37 GMT",
+						   std::chrono::system_clock::from_time_t(784111717)) ==
+	   std::chrono::seconds(60));
+    cout << "13: _" << endl;
+    scheduler.write_metrics(cout, now);
+    cout << "_" << endl;
+  }
+  {
+    const string warc("WARC/1.0\r\nWARC-Type: warcinfo\r\nContent-Length: 0\r\n\r\n\r\n\r\n" +
+		      warc_response("http://www.sueddeutsche.de/",
+				    "<a href=\"/any/path\">1</a><a href='other'>2</a><a href=\"#top\">3</a>") +
+		      warc_response("http://www.sueddeutsche.de/any/path",
+				    "<a href=\"http://www.sueddeutsche.de/\">1</a><a href=\"ftp://x/\">2</a>") +
+		      warc_response("http://www.sueddeutsche.de/chunked",
+				    "a\r\n<a href=\"/\r\n13\r\nchunked/next\">1</a>\r\n0\r\n\r\n",
+				    "HTTP/1.1 200 OK\r\nContent-Type: TEXT/HTML; charset=UTF-8\r\n"
+				    "Transfer-Encoding: chunked\r\n") +
+		      warc_response("http://www.sueddeutsche.de/partial", "<a href=\"/partial/next\">1</a>",
+				    "HTTP/1.1 206 Partial Content\r\nContent-Type: text/html\r\n"));
+    std::ofstream("./test/replay.warc", std::ios::binary) << warc;
+    gzFile file(gzopen("./test/replay.warc.gz", "wb"));
+    gzwrite(file, warc.data(), static_cast<unsigned>(warc.size()));
+    gzclose(file);
+
+    crawler_pp::policies::crawl_frontend<test_policy> frontend;
+    crawler_pp::warc::warc_replay<test_policy> replay(frontend);
+    replay.replay("./test/replay.warc");
+    // The chunked page is decoded, the partial content is no page
+    assert(replay.get_stats().records == 5 && replay.get_stats().pages == 3);
+    assert(replay.get_stats().links == 4 && replay.get_stats().admitted == 3);
+    assert(frontend.is_known("http://www.sueddeutsche.de/partial"));
+    replay.replay("./test/replay.warc.gz");
+    assert(replay.get_stats().records == 10 && replay.get_stats().admitted == 3);
+    assert(replay.get_stats().bytes == 2 * warc.size());
+
+    // A Content-Length beyond the end of the file is rejected
+    const string invalid("WARC/1.0\r\nWARC-Type: resource\r\nContent-Length: 18446744073709551615\r\n\r\n\r\n\r\n");
+    std::ofstream("./test/invalid.warc", std::ios::binary) << invalid;
+    file = gzopen("./test/invalid.warc.gz", "wb");
+    gzwrite(file, invalid.data(), static_cast<unsigned>(invalid.size()));
+    gzclose(file);
+    for(const char *path : {"./test/invalid.warc", "./test/invalid.warc.gz"}) {
+      crawler_pp::warc::warc_reader reader(path);
+      crawler_pp::warc::warc_record record;
+      try {
+	reader.next(record);
+	assert(false);
+      } catch(crawler_pp::exceptions::warc_exception&) {}
+    }
+    cout << "14: _" << replay.get_stats().responses_per_second() << " responses/sec_" << endl;
+  }
+  {
+    crawler_pp::storage::storage_options options;
+    // The files of earlier runs would match the globs below
+    std::system("rm -rf ./test/storage && mkdir -p ./test/storage");
+    options.writer.directory = "./test/storage";
+    options.writer.prefix = "storage";
+    options.writer.max_file_size = 512;
+    options.queue_capacity = 4;
+    {
+      crawler_pp::storage::storage_controller controller(options);
+      for(int i(0); i != 20; ++i) {
+	const string page("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n<p>" + std::to_string(i) + "</p>");
+	crawler_pp::storage::fetch_record record;
+	record.target_uri = "http://www.sueddeutsche.de/" + std::to_string(i);
+	record.date = std::chrono::system_clock::now();
+	record.request = "GET /" + std::to_string(i) + " HTTP/1.1\r\nHost: www.sueddeutsche.de\r\n\r\n";
+	record.response_length = page.size();
+	record.response = crawler_pp::warc::string_source(page);
+	record.status = 200;
+	record.mime = i ? "text/html" : " Text/HTML ; charset=UTF-8";
+	controller.store(std::move(record));
+      }
+      controller.flush();
+      assert(controller.get_written() == 20);
+    }
+    // The index of the first file names the record of the first page
+    string line, filename;
+    unsigned long long length(0), offset(0);
+    std::system("ls ./test/storage/storage-*.warc.gz.cdx | head -n 1 > ./test/storage/storage.lst");
+    std::ifstream("./test/storage/storage.lst") >> filename;
+    const int rotated(std::system("test -e ./test/storage/storage-*-00001.warc.gz"));
+    assert(!rotated);
+    std::ifstream index(filename.c_str());
+    std::getline(index, line);
+    assert(line == " CDX N b a m s k r M S V g");
+    std::getline(index, line);
+    char key[128], mime[128], file[128];
+    const int fields(std::sscanf(line.c_str(), "%127s %*s %*s %127s %*s %*s %*s %*s %llu %llu %127s",
+				 key, mime, &length, &offset, file));
+    assert(fields == 5);
+    assert(string(key) == "sueddeutsche.de/0" && string(mime) == "text/html");
+    const string record(crawler_pp::warc::read_record("./test/storage/" + string(file), offset, length));
+    assert(record.find("WARC-Type: response\r\n") != string::npos);
+    assert(record.find("<p>0</p>\r\n\r\n") == record.size() - 12);
+
+    crawler_pp::warc::warc_reader reader("./test/storage/" + string(file));
+    crawler_pp::warc::warc_record next;
+    bool found(reader.next(next));
+    assert(found && next.type == "warcinfo");
+    found = reader.next(next);
+    assert(found && next.type == "response");
+    const string response_id(next.get_header("WARC-Record-ID"));
+    found = reader.next(next);
+    assert(found && next.type == "request");
+    assert(next.get_header("WARC-Concurrent-To") == response_id);
+
+    // Existing files of this and the next second are not overwritten, a file
+    // whose index exists is skipped as a whole
+    crawler_pp::warc::warc_writer_options writer_options;
+    writer_options.directory = "./test/storage";
+    writer_options.prefix = "exclusive";
+    const std::time_t now(std::time(nullptr));
+    for(std::time_t time(now); time != now + 2; ++time) {
+      char stamp[32];
+      std::strftime(stamp, sizeof(stamp), "%Y%m%d%H%M%S", std::gmtime(&time));
+      std::ofstream("./test/storage/exclusive-" + string(stamp) + "-00000.warc.gz") << "keep";
+      std::ofstream("./test/storage/exclusive-" + string(stamp) + "-00001.warc.gz.cdx") << "keep";
+    }
+    crawler_pp::warc::warc_writer writer(writer_options);
+    crawler_pp::warc::warc_record_header header;
+    header.type = "resource";
+    header.record_id = crawler_pp::warc::warc_writer::make_record_id();
+    header.date = std::chrono::system_clock::now();
+    const crawler_pp::warc::record_location location(writer.write_record(header, 4,
+									   crawler_pp::warc::string_source("data")));
+    writer.close();
+    assert(location.filename.find("-00002.warc.gz") != string::npos);
+    const int skipped(std::system("test -e ./test/storage/exclusive-*-00001.warc.gz"));
+    const int kept(std::system("test $(grep -l keep ./test/storage/exclusive-*-00000.warc.gz | wc -l) = 2"));
+    assert(skipped && !kept);
+
+    // A source that fails within a record does not leave a partial gzip
+    // member in the file
+    writer_options.prefix = "failing";
+    crawler_pp::warc::warc_writer failing(writer_options);
+    const crawler_pp::warc::record_location complete(failing.write_record(header, 4,
+									     crawler_pp::warc::string_source("data")));
+    uint32_t state(1);
+    size_t produced(0);
+    try {
+      failing.write_record(header, 4 << 20, [&state, &produced](char *data, size_t size) -> size_t {
+	  if(produced >= (1 << 20)) throw crawler_pp::exceptions::warc_exception("The source failed", "test");
+	  // Incompressible bytes are written to the file before the failure
+	  for(size_t i(0); i != size; ++i) {
+	    state = state * 1103515245 + 12345;
+	    data[i] = static_cast<char>(state >> 24);
+	  }
+	  produced += size;
+	  return size;
+	});
+      assert(false);
+    } catch(crawler_pp::exceptions::warc_exception&) {}
+    crawler_pp::warc::warc_reader failed("./test/storage/" + complete.filename);
+    found = failed.next(next);
+    assert(found && next.type == "warcinfo");
+    found = failed.next(next);
+    assert(found && next.type == "resource");
+    found = failed.next(next);
+    assert(!found);
+    const std::streamoff size(std::ifstream("./test/storage/" + complete.filename,
+					    std::ios::binary | std::ios::ate).tellg());
+    assert(static_cast<uint64_t>(size) == complete.offset + complete.length);
+    cout << "15: _" << filename << "_" << endl;
+  }
+  {
+    std::ofstream("./test/sitemap-index.xml") <<
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<sitemapindex xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n"
+      "  <sitemap><loc>http://www.sueddeutsche.de/sitemap-1.xml.gz</loc></sitemap>\n"
+      "  <sitemap><loc>http://www.sueddeutsche.de/sitemap-2.xml</loc></sitemap>\n"
+      "  <sitemap><loc>http://www.sueddeutsche.de/sitemap-3.xml</loc></sitemap>\n"
+      "</sitemapindex>\n";
+    const string first("<?xml version=\"1.0\"?>\n<!-- <url><loc>http://www.sueddeutsche.de/x</loc></url> -->\n"
+		       "<urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n"
+		       "<url><loc>http://www.sueddeutsche.de/a</loc><priority>0.2</priority></url>\n"
+		       "<url>\n  <loc> http://www.sueddeutsche.de/b?x=1&amp;y=2 </loc>\n"
+		       "  <lastmod>2014-09-30T12:00:00+02:00</lastmod>\n  <priority>0.9</priority>\n</url>\n"
+		       "<url><loc><![CDATA[http://www.sueddeutsche.de/c]]></loc><priority>0.05</priority></url>\n"
+		       "</urlset>\n");
+    gzFile file(gzopen("./test/sitemap-1.xml.gz", "wb"));
+    gzwrite(file, first.data(), static_cast<unsigned>(first.size()));
+    gzclose(file);
+    std::ofstream("./test/sitemap-2.xml") <<
+      "<sm:urlset xmlns:sm=\"http://www.sitemaps.org/schemas/sitemap/0.9\" "
+      "xmlns:image=\"http://www.google.com/schemas/sitemap-image/1.1\">"
+      "<sm:url><sm:loc>http://www.sueddeutsche.de/a</sm:loc></sm:url>"
+      "<sm:url><sm:loc>ftp://www.sueddeutsche.de/</sm:loc></sm:url>"
+      "<sm:url><sm:loc>http://www.sueddeutsche.de/d</sm:loc><sm:lastmod>2014-09-30</sm:lastmod>"
+      "<image:image><image:loc>http://www.sueddeutsche.de/d.jpg</image:loc></image:image></sm:url>"
+      "</sm:urlset>";
+
+    std::chrono::system_clock::time_point date;
+    const bool parsed(crawler_pp::extraction::parse_w3c_datetime("2014-09-30T12:00:00+02:00", date));
+    assert(parsed && date == std::chrono::system_clock::from_time_t(1412071200));
+    const bool truncated(crawler_pp::extraction::parse_w3c_datetime("2014-09-30T12", date));
+    assert(!truncated);
+
+    crawler_pp::policies::crawl_frontend<test_policy> frontend;
+    crawler_pp::extraction::sitemap_options options;
+    options.batch_size = 3;
+    options.min_priority = 0.1;
+    crawler_pp::extraction::sitemap_ingester<test_policy> ingester(frontend, options);
+    ingester.ingest("./test/sitemap-index.xml");
+    const crawler_pp::extraction::sitemap_stats &stats(ingester.get_stats());
+    assert(stats.sitemaps == 3 && stats.entries == 6 && stats.skipped == 2);
+    assert(stats.admitted == 3 && stats.duplicates == 1 && stats.rejected == 1);
+    std::vector<string> seeds;
+    while(frontend.has_next()) seeds.push_back(frontend.get_next().get_value());
+    assert(seeds == std::vector<string>({"http://www.sueddeutsche.de/b?x=1&y=2", "http://www.sueddeutsche.de/a",
+					 "http://www.sueddeutsche.de/d"}));
+    cout << "16: _" << stats.entries_per_minute() << " entries/min_" << endl;
+  }
+  {
+    string root;
+    const int listener(listen_loopback(root));
+    std::thread server(serve_pages, listener, 6);
+
+    crawler_pp::policies::crawl_frontend<test_policy> frontend;
+    frontend.admit(root);
+    frontend.admit("https://www.sueddeutsche.de/");
+    crawler_pp::scheduling::controller_options controller;
+    controller.initial_delay = std::chrono::milliseconds(0);
+    crawler_pp::scheduling::scheduler scheduler(controller);
+    crawler_pp::resolving::address_resolver resolver;
+    crawler_pp::storage::storage_options storage_options;
+    storage_options.writer.directory = "./test";
+    storage_options.writer.prefix = "pipeline";
+    // The smallest queue, so the fetches may wait for free space
+    storage_options.queue_capacity = 2;
+    crawler_pp::storage::storage_controller storage(storage_options);
+    crawler_pp::scheduling::pipeline_options options;
+    options.threads = 2;
+    options.max_in_flight = 2;
+    options.timeout = std::chrono::milliseconds(5000);
+    std::vector<int> statuses;
+    std::vector<string> found;
+    std::mutex mutex;
+    crawler_pp::scheduling::crawl_pipeline pipeline(options, scheduler, resolver, &storage,
+      [&frontend](string &uri){
+	if(!frontend.has_next()) return false;
+	const crawler_pp::data::waiting_uri next(frontend.get_next());
+	frontend.mark_visited(next);
+	uri = next.get_value();
+	return true;
+      },
+      [&frontend, &statuses, &found, &mutex](const string &uri, int status, uint64_t content,
+					     std::vector<string> &links){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(content) frontend.observe(uri, content);
+	statuses.push_back(status);
+	found.insert(found.end(), links.begin(), links.end());
+	for(size_t i(0); i != links.size(); ++i) frontend.admit(links[i]);
+      });
+    pipeline.run();
+    server.join();
+    close(listener);
+    storage.flush();
+    const crawler_pp::scheduling::pipeline_stats stats(pipeline.get_stats());
+    assert(stats.started == 7 && stats.fetched == 4 && stats.unsupported == 1 && stats.failed == 2);
+    assert(stats.links == 7 && stats.stored == 4 && stats.peak_in_flight <= 2);
+    std::sort(statuses.begin(), statuses.end());
+    assert(statuses == std::vector<int>({200, 200, 200, 404}));
+    assert(std::count(found.begin(), found.end(), root + "c") == 1);
+    assert(std::count(found.begin(), found.end(), root + "e") == 1);
+    assert(std::count(found.begin(), found.end(), root + "g") == 0);
+    assert(storage.get_written() == 4);
+    // The failed request released its slot of the host
+    const std::vector<std::pair<string, crawler_pp::scheduling::host_metrics> > metrics(scheduler.get_metrics());
+    for(size_t i(0); i != metrics.size(); ++i) assert(!metrics[i].second.in_flight);
+    cout << "17: _" << stats.fetched << " fetches, " << stats.links << " links_" << endl;
+  }
+  {
+    crawler_pp::policies::analyzer_options options;
+    options.window = 16;
+    options.max_cardinality = 4;
+    options.trap_budget = 3;
+    options.max_deferred = 1;
+    options.max_decisions = 4;
+    crawler_pp::policies::crawl_frontend<analyzer_policy> frontend(crawler_pp::policies::memory_frontier{},
+								   crawler_pp::policies::memory_dedup{},
+								   crawler_pp::policies::url_analyzer(options));
+    bool admitted(frontend.admit("http://www.s.de/a?utm_source=x&id=1"));
+    string next(frontend.get_next().get_value());
+    assert(admitted && next == "http://www.s.de/a?id=1");
+    admitted = frontend.admit("http://www.s.de/b;jsessionid=F00");
+    next = frontend.get_next().get_value();
+    assert(admitted && next == "http://www.s.de/b");
+
+    // Variants that only differ in sid have the same content, the pages of k
+    // differ
+    const uint64_t content(crawler_pp::utils::simhash("some content of a page", 22));
+    frontend.observe("http://www.s.de/p?sid=1", content);
+    frontend.observe("http://www.s.de/p?sid=2", content);
+    frontend.observe("http://www.s.de/p?sid=3", content ^ 1);
+    frontend.observe("http://www.s.de/p?sid=4", content);
+    frontend.observe("http://www.s.de/p?k=1", content);
+    frontend.observe("http://www.s.de/p?k=2", ~content);
+    frontend.observe("http://www.s.de/p?k=3", content);
+    admitted = frontend.admit("http://www.s.de/q?sid=9&k=1");
+    next = frontend.get_next().get_value();
+    assert(admitted && next == "http://www.s.de/q?k=1");
+    frontend.mark_visited(crawler_pp::data::visited_uri("http://www.s.de/q?k=1",
+							crawler_pp::data::uri::normalized_value()));
+    assert(frontend.is_known("http://www.s.de/q?sid=5&k=1"));
+
+    // The fifth value of s and the repeated segments are suspected, the
+    // fourth suspected uri exceeds the trap budget and is deferred, the
+    // fifth one is rejected
+    size_t listed(0);
+    for(int i(1); i != 7; ++i) listed += frontend.admit("http://www.s.de/list?s=" + std::to_string(i));
+    const bool repeated(frontend.admit("http://www.s.de/a/b/a/b/a/b"));
+    const bool deferred(frontend.admit("http://www.s.de/c/d/c/d/c/d"));
+    const bool rejected(frontend.admit("http://www.s.de/1/2/3/4/5/6/7/8/9/10/11/12/13"));
+    assert(listed == 6 && repeated && !deferred && !rejected);
+    while(frontend.has_next()) frontend.get_next();
+
+    crawler_pp::policies::url_analyzer &analyzer(frontend.get_canonicalizer());
+    const crawler_pp::policies::host_analysis analysis(analyzer.get_analysis("WWW.S.DE"));
+    assert(analysis.stripped == std::vector<string>({"sid"}));
+    assert(analysis.suspicious == std::vector<string>({"s"}));
+    assert(analysis.admitted == 7 && analysis.suspected == 3 && analysis.deferred == 1 && analysis.rejected == 1);
+    const std::vector<crawler_pp::policies::analyzer_decision> decisions(analyzer.get_decisions());
+    assert(decisions.size() == 4 && decisions[0].uri == "http://www.s.de/list?s=6");
+    assert(decisions[1].admitted && decisions[1].reason == "repeated segment a");
+    assert(!decisions[2].admitted && decisions[3].reason == "depth 13");
+    std::ostringstream metrics;
+    analyzer.write_metrics(metrics);
+    assert(metrics.str().find("crawler_pp_analyzer_stripped_parameter{host=\"www.s.de\",parameter=\"sid\"} 1\n") != string::npos);
+
+    // Rediscovered uris get their decision again without spending budget,
+    // being deferred twice or adding a decision
+    const bool readmitted(analyzer.admit("http://www.s.de/a/b/a/b/a/b"));
+    const bool redeferred(analyzer.admit("http://www.s.de/c/d/c/d/c/d"));
+    const bool rerejected(analyzer.admit("http://www.s.de/1/2/3/4/5/6/7/8/9/10/11/12/13"));
+    assert(readmitted && !redeferred && !rerejected);
+    const crawler_pp::policies::host_analysis rediscovered(analyzer.get_analysis("www.s.de"));
+    assert(rediscovered.suspected == 3 && rediscovered.deferred == 1 && rediscovered.rejected == 1);
+    assert(analyzer.get_decisions().back().reason == "depth 13");
+
+    // The budget refills once the first suspected uri left the window
+    size_t pages(0);
+    for(int i(0); i != 11; ++i) pages += frontend.admit("http://www.s.de/page-" + string(1, 'a' + i));
+    std::vector<string> scheduled;
+    while(frontend.has_next()) scheduled.push_back(frontend.get_next().get_value());
+    assert(pages == 11 && scheduled.size() == 11);
+    assert(std::count(scheduled.begin(), scheduled.end(), "http://www.s.de/c/d/c/d/c/d") == 0);
+    admitted = frontend.admit("http://www.s.de/page-z");
+    scheduled.clear();
+    while(frontend.has_next()) scheduled.push_back(frontend.get_next().get_value());
+    assert(admitted && scheduled == std::vector<string>({"http://www.s.de/page-z", "http://www.s.de/c/d/c/d/c/d"}));
+    assert(analyzer.get_analysis("www.s.de").suspected == 4 && !analyzer.get_analysis("www.s.de").deferred);
+
+    // Unfetched numbering patterns are no traps, the state of the least
+    // recently discovered host is dropped
+    options = crawler_pp::policies::analyzer_options();
+    options.window = 0;
+    options.max_hosts = 2;
+    crawler_pp::policies::url_analyzer defaults(options);
+    size_t products(0);
+    for(int i(0); i != 2000; ++i) products += defaults.admit("http://shop.de/product/" + std::to_string(i));
+    const bool first_host(defaults.admit("http://a.de/"));
+    const bool second_host(defaults.admit("http://b.de/"));
+    assert(products == 2000 && first_host && second_host);
+    assert(!defaults.get_analysis("shop.de").admitted && defaults.get_analysis("b.de").admitted == 1);
+
+    // The deferred uris of a dropped host are released
+    options.window = 16;
+    options.max_depth = 2;
+    options.trap_budget = 1;
+    options.max_hosts = 1;
+    crawler_pp::policies::url_analyzer evicting(options);
+    const bool spent(evicting.admit("http://d.de/1/2/3"));
+    const bool held(evicting.admit("http://d.de/4/5/6"));
+    const bool other(evicting.admit("http://e.de/"));
+    assert(spent && !held && other);
+    std::vector<string> released;
+    evicting.release(released);
+    assert(released == std::vector<string>({"http://d.de/4/5/6"}));
+
+    // The state of patterns and parameters that were observed once is
+    // dropped with the window, learned parameters are kept
+    options.window = 4;
+    crawler_pp::policies::url_analyzer observed(options);
+    for(int i(1); i != 5; ++i) observed.observe("http://t.de/p?sid=" + std::to_string(i), content);
+    for(int i(0); i != 1000; ++i) observed.observe("http://t.de/p?p" + std::to_string(i) + "=1", content);
+    const crawler_pp::policies::host_analysis aged(observed.get_analysis("t.de"));
+    assert(aged.stripped == std::vector<string>({"sid"}));
+    assert(aged.patterns <= 2 * options.window && aged.parameters <= 2 * options.window + 1);
+    cout << "18: _" << analysis.rejected << " uris rejected_" << endl;
+  }
+  if(std::getenv("CRAWLER_PP_DB")) {
+    // Requires a dedicated PostgreSQL database with the schema of
+    // odb/uri.sql that is accessible by the current user, the test takes
+    // all waiting uris, so it refuses to run if there are any
+    crawler_pp::data::database_options options;
+    options.name = std::getenv("CRAWLER_PP_DB");
+    options.connections = 4;
+    std::shared_ptr<crawler_pp::data::database> db(new crawler_pp::data::database(options));
+    crawler_pp::data::database::attach(db);
+    const bool waiting(crawler_pp::data::waiting_uri::has_next());
+    assert(!waiting);
+    const string prefix("http://www.sueddeutsche.de/" + std::to_string(std::time(nullptr)) + "/");
+    std::vector<std::thread> workers;
+    std::atomic<size_t> persisted(0);
+    for(int i(0); i != 4; ++i)
+      workers.push_back(std::thread([&prefix, &persisted, i](){
+	    for(int j(0); j != 100; ++j)
+	      if(crawler_pp::data::waiting_uri(prefix + std::to_string(i * 100 + j),
+					       crawler_pp::data::uri::normalized_value()).persist()) ++persisted;
+	  }));
+    for(size_t i(0); i != workers.size(); ++i) workers[i].join();
+    assert(persisted == 400);
+    crawler_pp::data::waiting_uri duplicate(prefix + "0", crawler_pp::data::uri::normalized_value());
+    const bool stored(duplicate.persist());
+    assert(!stored);
+    const bool known(crawler_pp::data::uri::is_known<crawler_pp::data::waiting_uri>(duplicate));
+    assert(known);
+    const crawler_pp::data::database_stats stats(db->get_stats());
+    assert(stats.writes == 401 && stats.transactions < stats.writes);
+    size_t found(0);
+    while(crawler_pp::data::waiting_uri::has_next())
+      if(!crawler_pp::data::waiting_uri::get_next().get_value().compare(0, prefix.size(), prefix)) ++found;
+    const bool taken(!crawler_pp::data::uri::is_known<crawler_pp::data::waiting_uri>(duplicate));
+    assert(found == 400 && taken);
+
+    // Only the write whose value exceeds the column fails, the other writes
+    // of its batch are stored
+    std::future<bool> first(db->persist(crawler_pp::data::visited_uri(prefix + "first",
+								      crawler_pp::data::uri::normalized_value())));
+    std::future<bool> invalid(db->persist(crawler_pp::data::visited_uri(prefix + string(4096, 'x'),
+									crawler_pp::data::uri::normalized_value())));
+    std::future<bool> last(db->persist(crawler_pp::data::visited_uri(prefix + "last",
+								     crawler_pp::data::uri::normalized_value())));
+    const bool first_stored(first.get());
+    const bool last_stored(last.get());
+    assert(first_stored && last_stored);
+    try {
+      invalid.get();
+      assert(false);
+    } catch(crawler_pp::exceptions::db_exception&) {}
+    crawler_pp::data::database::attach(nullptr);
+    cout << "19: _" << stats.transactions << " transactions_" << endl;
+  } else {
+    cout << "19: _skipped, CRAWLER_PP_DB is not set_" << endl;
+  }
 
-  
   cout << "===============================================================================" << endl;
   cout << "leaving tests.main" << endl;
 
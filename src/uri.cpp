@@ -14,8 +14,11 @@
 #define URI_CPP
 
 #include "uri.h"
+#include "crawl_frontend.h"
+#include "database.h"
 #include "exceptions.h"
 #include "utils.h"
+#include "visited_set.h"
 
 // std::move
 #include <utility>
@@ -23,12 +26,23 @@
 #include <exception>
 #include <network/uri.hpp>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 using std::string;
 using std::vector;
 using crawler_pp::exceptions::uri_exception;
 
+namespace {
+  // Returns the attached database, if no database is attached the
+  // crawler_pp::exceptions::db_exception is thrown.
+  std::shared_ptr<crawler_pp::data::database> get_database(){
+    std::shared_ptr<crawler_pp::data::database> db(crawler_pp::data::database::get_attached());
+    if(!db) throw crawler_pp::exceptions::db_exception("No database attached!");
+    return db;
+  }
+} // end of anonymous namespace
+
 // ============================================================================
 // === the uri class ==========================================================
 // ============================================================================
@@ -49,6 +63,9 @@ crawler_pp::data::uri::uri(string uri){
   this->set_value(uri);
 }
 
+crawler_pp::data::uri::uri(string uri, const crawler_pp::data::uri::normalized_value&)
+  :value_(std::move(uri)) {}
+
 crawler_pp::data::uri::uri(const crawler_pp::data::uri& uri){
   // self-assignment is OK
   this->value_ = uri.get_value();
@@ -144,27 +161,9 @@ string crawler_pp::data::uri::get_value() const {
 }
 
 void crawler_pp::data::uri::set_value(string uri){
-  try {
-    network::uri tmp(network::uri(uri).normalize(network::uri_comparison_level::syntax_based));
-    if(!tmp.is_absolute() || tmp.empty())
-      throw uri_exception("Uri must be absolute!", uri);
-    if(crawler_pp::utils::to_string<network::uri>(tmp).size() > crawler_pp::data::uri::MAX_SIZE)
-      throw uri_exception("Uri must be shorter or equal to " + std::to_string(MAX_SIZE) +
-			  " characters!", uri);
-    if(std::find(SUPPORTED_SCHEMES.begin(), SUPPORTED_SCHEMES.end(), tmp.scheme().get()) ==
-       SUPPORTED_SCHEMES.end())
-      throw uri_exception("The scheme " + static_cast<string>(tmp.scheme().get()) +
-			  " is not supported!", uri);
-
-    // TODO: always set a port (default port, :, ...)
-    // TODO: add asserts to test.cpp::main
-
-    this->value_ = crawler_pp::utils::to_string<network::uri>(tmp);
-  } catch(std::exception& e){
-    throw uri_exception(e.what(), uri);
-  } catch(...) {
-    throw uri_exception("Could not create uri from string!", uri);
-  }
+  // TODO: always set a port (default port, :, ...)
+  // TODO: add asserts to test.cpp::main
+  this->value_ = crawler_pp::policies::default_crawl_frontend::normalize(uri);
 }
 
 template<typename T>
@@ -174,8 +173,21 @@ bool crawler_pp::data::uri::is_known(const crawler_pp::data::uri& uri){
 
 template<typename T>
 bool crawler_pp::data::uri::is_known(std::string uri){
-  // TODO: implement
-  throw crawler_pp::exceptions::not_implemented_exception();
+  return get_database()->is_known<T>(T(uri).get_value());
+}
+
+template bool crawler_pp::data::uri::is_known<crawler_pp::data::waiting_uri>(const crawler_pp::data::uri&);
+template bool crawler_pp::data::uri::is_known<crawler_pp::data::waiting_uri>(std::string);
+template<>
+bool crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>(const crawler_pp::data::uri& uri){
+  std::shared_ptr<crawler_pp::data::visited_set> set(crawler_pp::data::visited_set::get_attached());
+  if(!set) return get_database()->is_known<crawler_pp::data::visited_uri>(uri.get_value());
+  return set->contains(crawler_pp::utils::fingerprint(uri.get_value()));
+}
+
+template<>
+bool crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>(std::string uri){
+  return crawler_pp::data::uri::is_known<crawler_pp::data::visited_uri>(crawler_pp::data::visited_uri(uri));
 }
 
 crawler_pp::data::uri::~uri() {}
@@ -193,11 +205,15 @@ crawler_pp::data::waiting_uri::waiting_uri() :crawler_pp::data::uri() {}
 crawler_pp::data::waiting_uri::waiting_uri(string uri)
   :crawler_pp::data::uri(uri) {}
 
+crawler_pp::data::waiting_uri::waiting_uri(string uri,
+					    const crawler_pp::data::uri::normalized_value &tag)
+  :crawler_pp::data::uri(std::move(uri), tag) {}
+
 crawler_pp::data::waiting_uri::waiting_uri(const crawler_pp::data::waiting_uri &uri)
   :crawler_pp::data::uri(uri) {}
 
 crawler_pp::data::waiting_uri::waiting_uri(crawler_pp::data::waiting_uri &&uri)
-  :crawler_pp::data::uri(std::move(uri.value_)) {}
+  :crawler_pp::data::uri(std::move(uri)) {}
 
 crawler_pp::data::waiting_uri&
   crawler_pp::data::waiting_uri::operator=(const crawler_pp::data::waiting_uri &uri){
@@ -217,19 +233,18 @@ crawler_pp::data::waiting_uri&
 }
 
 bool crawler_pp::data::waiting_uri::persist() {
-  // TOOD: throw db_exception if an error occurs
-  // TODO: implement
-  throw crawler_pp::exceptions::not_implemented_exception();
+  // The write is committed together with the writes of other threads
+  return get_database()->persist(*this).get();
 }
 
 crawler_pp::data::waiting_uri crawler_pp::data::waiting_uri::get_next(){
-  // TODO: implement
-  throw crawler_pp::exceptions::not_implemented_exception();
+  crawler_pp::data::waiting_uri uri;
+  if(!get_database()->get_next(uri)) throw crawler_pp::exceptions::db_exception("No waiting uri available!");
+  return uri;
 }
 
 bool crawler_pp::data::waiting_uri::has_next(){
-  // TODO: implement
-  throw crawler_pp::exceptions::not_implemented_exception();
+  return get_database()->has_next();
 }
 
 crawler_pp::data::waiting_uri::~waiting_uri() {}
@@ -242,8 +257,15 @@ crawler_pp::data::visited_uri::visited_uri() :crawler_pp::data::uri() {}
 crawler_pp::data::visited_uri::visited_uri(string uri)
   :crawler_pp::data::uri(uri) {}
 
+crawler_pp::data::visited_uri::visited_uri(string uri,
+					    const crawler_pp::data::uri::normalized_value &tag)
+  :crawler_pp::data::uri(std::move(uri), tag) {}
+
 crawler_pp::data::visited_uri::visited_uri(const crawler_pp::data::visited_uri &uri)
-  :crawler_pp::data::visited_uri(uri.get_value()) {}
+  :crawler_pp::data::uri(uri) {}
+
+crawler_pp::data::visited_uri::visited_uri(crawler_pp::data::visited_uri &&uri)
+  :crawler_pp::data::uri(std::move(uri)) {}
 
 crawler_pp::data::visited_uri&
   crawler_pp::data::visited_uri::operator=(const crawler_pp::data::visited_uri& uri){
@@ -263,9 +285,9 @@ crawler_pp::data::visited_uri&
 }
 
 bool crawler_pp::data::visited_uri::persist(){
-  // TOOD: throw db_exception if an error occurs
-  // TODO: implement
-  throw crawler_pp::exceptions::not_implemented_exception();
+  std::shared_ptr<crawler_pp::data::visited_set> set(crawler_pp::data::visited_set::get_attached());
+  if(!set) return get_database()->persist(*this).get();
+  return set->insert(crawler_pp::utils::fingerprint(this->get_value()));
 }
 
 crawler_pp::data::visited_uri::~visited_uri() {}
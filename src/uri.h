@@ -37,9 +37,17 @@ namespace crawler_pp {
       static const std::string SCHEME_HTTP;
       // Defines the URI scheme "HTTPS"
       static const std::string SCHEME_HTTPS;
+      // A tag type that selects the constructors which take an already
+      // normalized URI string, e.g. the string returned by
+      // crawler_pp::policies::crawl_frontend::normalize.
+      struct normalized_value {};
       // This constructor takes a string representing an URI and uses this
       // value as internal URI of this class.
       uri(std::string);
+      // This constructor takes a string representing an already normalized
+      // URI and uses this value as internal URI of this class without
+      // performing any normalization.
+      uri(std::string, const normalized_value&);
       // The copy constructor, copies the normalized URI value from the passed
       // uri instance.
       uri(const uri&);
@@ -149,6 +157,9 @@ namespace crawler_pp {
       // This constructor takes a string representing an URI and uses this
       // value as internal URI of this class.
       waiting_uri(std::string);
+      // This constructor takes a string representing an already normalized
+      // URI, see: crawler_pp::data::uri::uri(std::string, const normalized_value&)
+      waiting_uri(std::string, const normalized_value&);
       // The copy constructor, copies the normalized URI value from the passed
       // waiting_uri instance.
       waiting_uri(const waiting_uri&);
@@ -184,6 +195,9 @@ namespace crawler_pp {
       // This constructor takes a string representing an URI and uses this
       // value as internal URI of this class.
       visited_uri(std::string);
+      // This constructor takes a string representing an already normalized
+      // URI, see: crawler_pp::data::uri::uri(std::string, const normalized_value&)
+      visited_uri(std::string, const normalized_value&);
       // The copy constructor, copies the normalized URI value from the passed
       // visited_uri instance.
       visited_uri(const visited_uri&);
@@ -206,6 +220,11 @@ namespace crawler_pp {
       visited_uri();
     }; // end of class visited_uri
 
+    // The visited uris are looked up in the visited_set that is attached by
+    // crawler_pp::data::visited_set::attach.
+    template<> bool uri::is_known<visited_uri>(const uri&);
+    template<> bool uri::is_known<visited_uri>(std::string);
+
     // Writes the passed uri instance to the given ostream.
     std::ostream& operator<<(std::ostream&, const uri&);
   } // end of namespace data
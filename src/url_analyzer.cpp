@@ -0,0 +1,436 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: url_analyzer.cpp
+// Description: This implementation file implements the url_analyzer class
+//              that detects crawler traps and variants of the same page.
+// Public interfaces:
+//   * analyzer_options
+//   * analyzer_decision
+//   * host_analysis
+//   * url_analyzer
+// ============================================================================
+
+
+#include "url_analyzer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+using std::string;
+using std::vector;
+using crawler_pp::utils::fingerprint;
+
+namespace {
+  // The maximum number of pages per parameter whose fingerprints are kept
+  // to compare them with variants that are fetched later
+  const size_t MAX_PAGES(4096);
+  // The maximum number of learned parameters per host that are kept while
+  // they are not in the window
+  const size_t MAX_IDLE_STRIPPED(256);
+
+  // The components of an absolute uri
+  struct uri_parts {
+    // The scheme and the authority
+    string prefix;
+    string path;
+    // The lower case name and the unchanged "name=value" of each parameter
+    vector<std::pair<string, string> > parameters;
+    // The fragment including '#'
+    string fragment;
+  };
+
+  // Splits the passed absolute uri into its components.
+  void split_uri(const string &uri, uri_parts &parts){
+    size_t begin(uri.find("://"));
+    begin = begin == string::npos ? 0 : begin + 3;
+    const size_t path(uri.find_first_of("/?#", begin));
+    parts.prefix = uri.substr(0, path);
+    if(path == string::npos) return;
+    const size_t query(uri.find_first_of("?#", path));
+    parts.path = uri.substr(path, query - path);
+    if(query == string::npos) return;
+    const size_t hash(uri.find('#', query));
+    if(uri[query] == '?') {
+      for(size_t i(query + 1); i < std::min(hash, uri.size()); ) {
+	const size_t end(std::min(uri.find('&', i), hash));
+	if(end != i) {
+	  const string piece(uri.substr(i, end - i));
+	  parts.parameters.push_back(std::make_pair(crawler_pp::utils::string_to_lower(piece.substr(0, piece.find('='))),
+						    piece));
+	}
+	if(end == string::npos) break;
+	i = end + 1;
+      }
+    }
+    if(hash != string::npos) parts.fragment = uri.substr(hash);
+  }
+
+  // Returns the passed components as uri.
+  string join_uri(const uri_parts &parts){
+    string result(parts.prefix + parts.path);
+    for(size_t i(0); i != parts.parameters.size(); ++i) {
+      result += i ? '&' : '?';
+      result += parts.parameters[i].second;
+    }
+    return result + parts.fragment;
+  }
+
+  // Returns the value of the passed "name=value" parameter.
+  string parameter_value(const string &piece){
+    const size_t equals(piece.find('='));
+    return equals == string::npos ? string() : piece.substr(equals + 1);
+  }
+
+  // Returns the numbering pattern of the passed uri, i.e. its path with all
+  // runs of digits replaced by '#' and the sorted names of its parameters.
+  string pattern_key(const uri_parts &parts){
+    string key;
+    for(size_t i(0); i != parts.path.size(); ++i) {
+      if(!std::isdigit(static_cast<unsigned char>(parts.path[i]))) key += parts.path[i];
+      else if(key.empty() || key[key.size() - 1] != '#') key += '#';
+    }
+    vector<string> names;
+    for(size_t i(0); i != parts.parameters.size(); ++i) names.push_back(parts.parameters[i].first);
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for(size_t i(0); i != names.size(); ++i) key += (i ? '&' : '?') + names[i];
+    return key;
+  }
+
+  // Returns the number of different bits of the passed fingerprints.
+  unsigned distance(uint64_t lhs, uint64_t rhs){
+    return __builtin_popcountll(lhs ^ rhs);
+  }
+} // end of anonymous namespace
+
+crawler_pp::policies::url_analyzer::url_analyzer(const crawler_pp::policies::analyzer_options &options)
+  :options_(options) {
+  this->options_.window = std::max<size_t>(1, this->options_.window);
+  this->options_.max_hosts = std::max<size_t>(1, this->options_.max_hosts);
+  for(size_t i(0); i != this->options_.strip_parameters.size(); ++i)
+    this->options_.strip_parameters[i] = crawler_pp::utils::string_to_lower(this->options_.strip_parameters[i]);
+}
+
+crawler_pp::policies::url_analyzer::url_analyzer(crawler_pp::policies::url_analyzer &&other){
+  std::lock_guard<std::mutex> lock(other.mutex_);
+  this->options_ = std::move(other.options_);
+  this->hosts_ = std::move(other.hosts_);
+  this->recent_ = std::move(other.recent_);
+  this->released_ = std::move(other.released_);
+  this->decisions_ = std::move(other.decisions_);
+}
+
+bool crawler_pp::policies::url_analyzer::strip_always(const string &name) const {
+  for(size_t i(0); i != this->options_.strip_parameters.size(); ++i) {
+    const string &pattern(this->options_.strip_parameters[i]);
+    if(!pattern.empty() && pattern[pattern.size() - 1] == '*' ?
+       !name.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) : name == pattern)
+      return true;
+  }
+  return false;
+}
+
+bool crawler_pp::policies::url_analyzer::is_suspicious(const parameter_state &state) const {
+  return !state.stripped && state.values.size() > this->options_.max_cardinality &&
+    state.different < this->options_.min_evidence;
+}
+
+void crawler_pp::policies::url_analyzer::canonicalize(string &value){
+  uri_parts parts;
+  split_uri(value, parts);
+  bool changed(false);
+  // Session ids are also passed as path parameters, e.g. ";jsessionid=..."
+  if(parts.path.find(';') != string::npos) {
+    string path;
+    for(size_t i(0); i < parts.path.size(); ) {
+      const size_t end(std::min(parts.path.find_first_of(";/", i + 1), parts.path.size()));
+      const string piece(parts.path.substr(i, end - i));
+      if(piece[0] == ';' && this->strip_always(crawler_pp::utils::string_to_lower(piece.substr(1, piece.find('=') - 1))))
+	changed = true;
+      else
+	path += piece;
+      i = end;
+    }
+    parts.path = path;
+  }
+  if(parts.parameters.empty() && !changed) return;
+
+  vector<std::pair<string, string> > parameters;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    const std::unordered_map<string, host_state>::const_iterator
+      host(this->hosts_.find(crawler_pp::utils::string_to_lower(crawler_pp::utils::uri_authority(value))));
+    for(size_t i(0); i != parts.parameters.size(); ++i) {
+      const string &name(parts.parameters[i].first);
+      if(this->strip_always(name)) continue;
+      if(host != this->hosts_.end()) {
+	const std::unordered_map<string, parameter_state>::const_iterator state(host->second.parameters.find(name));
+	if(state != host->second.parameters.end() && state->second.stripped) continue;
+      }
+      parameters.push_back(parts.parameters[i]);
+    }
+  }
+  if(parameters.size() == parts.parameters.size() && !changed) return;
+  parts.parameters.swap(parameters);
+  value = join_uri(parts);
+}
+
+string crawler_pp::policies::url_analyzer::find_trap(const host_state &host, const string &path,
+						     const window_entry &entry) const {
+  vector<string> segments;
+  for(size_t i(0); i < path.size(); ) {
+    const size_t end(std::min(path.find('/', i), path.size()));
+    if(end != i) segments.push_back(path.substr(i, end - i));
+    i = end + 1;
+  }
+  if(segments.size() > this->options_.max_depth) return "depth " + crawler_pp::utils::to_string(segments.size());
+  std::unordered_map<string, size_t> repetitions;
+  for(size_t i(0); i != segments.size(); ++i)
+    if(++repetitions[segments[i]] >= this->options_.max_repetitions) return "repeated segment " + segments[i];
+
+  for(size_t i(0); i != entry.parameters.size(); ++i) {
+    const std::unordered_map<string, parameter_state>::const_iterator
+      state(host.parameters.find(entry.parameters[i].first));
+    if(state != host.parameters.end() && this->is_suspicious(state->second))
+      return "parameter " + entry.parameters[i].first;
+  }
+
+  // A pattern with many uris is suspected once most of its fetched pages
+  // were seen to have the same content
+  const pattern_state &pattern(host.patterns.find(entry.pattern)->second);
+  if(pattern.uris.size() > this->options_.max_pattern_size && pattern.observed && pattern.equal > pattern.different)
+    return "pattern";
+  return string();
+}
+
+void crawler_pp::policies::url_analyzer::touch(host_state &host){
+  // The maps are checked once per window, so each uri pays a constant share
+  if(++host.touched % this->options_.window) return;
+  for(std::unordered_map<uint64_t, pattern_state>::iterator it(host.patterns.begin()); it != host.patterns.end();) {
+    if(it->second.uris.empty() && host.touched - it->second.touched >= this->options_.window) it = host.patterns.erase(it);
+    else ++it;
+  }
+  size_t stripped(0);
+  for(std::unordered_map<string, parameter_state>::iterator it(host.parameters.begin()); it != host.parameters.end();) {
+    parameter_state &state(it->second);
+    if(!state.values.empty() || host.touched - state.touched < this->options_.window) {
+      ++it;
+    } else if(state.stripped && stripped < MAX_IDLE_STRIPPED) {
+      // A learned parameter is stripped by canonicalize, its pages are not
+      // needed anymore
+      ++stripped;
+      state.pages.clear();
+      ++it;
+    } else {
+      it = host.parameters.erase(it);
+    }
+  }
+}
+
+crawler_pp::policies::url_analyzer::host_state& crawler_pp::policies::url_analyzer::get_host(const string &name){
+  const std::unordered_map<string, host_state>::iterator host(this->hosts_.find(name));
+  if(host != this->hosts_.end()) {
+    this->recent_.splice(this->recent_.begin(), this->recent_, host->second.recent);
+    return host->second;
+  }
+  if(this->hosts_.size() >= this->options_.max_hosts) {
+    // The deferred uris would be lost with the state of their host
+    std::deque<string> &deferred(this->hosts_[this->recent_.back()].deferred);
+    this->released_.insert(this->released_.end(), std::make_move_iterator(deferred.begin()),
+			   std::make_move_iterator(deferred.end()));
+    this->hosts_.erase(this->recent_.back());
+    this->recent_.pop_back();
+  }
+  this->recent_.push_front(name);
+  host_state &result(this->hosts_[name]);
+  result.recent = this->recent_.begin();
+  return result;
+}
+
+bool crawler_pp::policies::url_analyzer::admit(const string &value){
+  uri_parts parts;
+  split_uri(value, parts);
+  window_entry entry;
+  entry.uri = fingerprint(value);
+  entry.pattern = fingerprint(pattern_key(parts));
+  for(size_t i(0); i != parts.parameters.size(); ++i)
+    entry.parameters.push_back(std::make_pair(parts.parameters[i].first,
+					      fingerprint(parameter_value(parts.parameters[i].second))));
+  const string name(crawler_pp::utils::string_to_lower(crawler_pp::utils::uri_authority(value)));
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  host_state &host(this->get_host(name));
+  // Links to calendars or pagers are rediscovered on every page, they
+  // neither spend budget nor are deferred twice
+  const std::unordered_map<uint64_t, uri_state>::const_iterator known(host.known.find(entry.uri));
+  if(known != host.known.end()) return known->second.admitted;
+
+  // The suspected uris that left the window return their budget, which is
+  // taken by the deferred uris first
+  ++host.discovered;
+  while(!host.spent.empty() && host.discovered - host.spent.front() >= this->options_.window) host.spent.pop_front();
+  while(!host.deferred.empty() && host.spent.size() < this->options_.trap_budget) {
+    host.spent.push_back(host.discovered);
+    ++host.suspected;
+    const std::unordered_map<uint64_t, uri_state>::iterator released(host.known.find(fingerprint(host.deferred.front())));
+    if(released->second.in_window) released->second = uri_state{true, false, true};
+    else host.known.erase(released);
+    this->released_.push_back(std::move(host.deferred.front()));
+    host.deferred.pop_front();
+  }
+
+  const uint64_t uri(entry.uri);
+  this->touch(host);
+  pattern_state &added(host.patterns[entry.pattern]);
+  ++added.uris[entry.uri];
+  added.touched = host.touched;
+  for(size_t i(0); i != entry.parameters.size(); ++i) {
+    parameter_state &state(host.parameters[entry.parameters[i].first]);
+    ++state.values[entry.parameters[i].second];
+    state.touched = host.touched;
+  }
+  host.window.push_back(std::move(entry));
+  if(host.window.size() > this->options_.window) {
+    const window_entry &oldest(host.window.front());
+    pattern_state &pattern(host.patterns[oldest.pattern]);
+    if(!--pattern.uris[oldest.uri]) pattern.uris.erase(oldest.uri);
+    if(pattern.uris.empty() && !pattern.observed) host.patterns.erase(oldest.pattern);
+    for(size_t i(0); i != oldest.parameters.size(); ++i) {
+      parameter_state &state(host.parameters[oldest.parameters[i].first]);
+      if(!--state.values[oldest.parameters[i].second]) state.values.erase(oldest.parameters[i].second);
+      if(state.values.empty() && state.pages.empty()) host.parameters.erase(oldest.parameters[i].first);
+    }
+    // A deferred uri keeps its decision until it is released
+    const std::unordered_map<uint64_t, uri_state>::iterator decision(host.known.find(oldest.uri));
+    if(decision->second.deferred) decision->second.in_window = false;
+    else host.known.erase(decision);
+    host.window.pop_front();
+  }
+
+  const string reason(this->find_trap(host, parts.path, host.window.back()));
+  if(reason.empty()) {
+    ++host.admitted;
+    host.known[uri] = uri_state{true, false, true};
+    return true;
+  }
+  const bool admitted(host.spent.size() < this->options_.trap_budget);
+  const bool deferred(!admitted && host.deferred.size() < this->options_.max_deferred);
+  if(admitted) {
+    host.spent.push_back(host.discovered);
+    ++host.suspected;
+  } else if(deferred) {
+    host.deferred.push_back(value);
+  } else {
+    ++host.rejected;
+  }
+  host.known[uri] = uri_state{admitted, deferred, true};
+  this->decisions_.push_back(analyzer_decision{value, admitted, reason});
+  if(this->decisions_.size() > this->options_.max_decisions) this->decisions_.pop_front();
+  return admitted;
+}
+
+void crawler_pp::policies::url_analyzer::release(vector<string> &values){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if(this->released_.empty()) return;
+  values.insert(values.end(), std::make_move_iterator(this->released_.begin()),
+		std::make_move_iterator(this->released_.end()));
+  this->released_.clear();
+}
+
+void crawler_pp::policies::url_analyzer::observe(const string &value, uint64_t content){
+  uri_parts parts;
+  split_uri(value, parts);
+  const uint64_t pattern_hash(fingerprint(pattern_key(parts)));
+  // Each parameter is compared with the variants of the page that only
+  // differ in its value, they share the path and all other parameters
+  vector<string> pieces;
+  for(size_t i(0); i != parts.parameters.size(); ++i) pieces.push_back(parts.parameters[i].second);
+  std::sort(pieces.begin(), pieces.end());
+  vector<std::pair<uint64_t, uint64_t> > variants;
+  for(size_t i(0); i != parts.parameters.size(); ++i) {
+    string rest(parts.path);
+    bool skipped(false);
+    for(size_t j(0); j != pieces.size(); ++j) {
+      if(!skipped && pieces[j] == parts.parameters[i].second) {
+	skipped = true;
+	continue;
+      }
+      rest += '&' + pieces[j];
+    }
+    variants.push_back(std::make_pair(fingerprint(rest), fingerprint(parameter_value(parts.parameters[i].second))));
+  }
+  const string name(crawler_pp::utils::string_to_lower(crawler_pp::utils::uri_authority(value)));
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  host_state &host(this->get_host(name));
+  this->touch(host);
+  pattern_state &pattern(host.patterns[pattern_hash]);
+  pattern.touched = host.touched;
+  if(pattern.observed) ++(distance(pattern.fingerprint, content) <= this->options_.max_distance ?
+			   pattern.equal : pattern.different);
+  pattern.fingerprint = content;
+  pattern.observed = true;
+
+  for(size_t i(0); i != parts.parameters.size(); ++i) {
+    parameter_state &state(host.parameters[parts.parameters[i].first]);
+    state.touched = host.touched;
+    const std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> >::iterator
+      page(state.pages.find(variants[i].first));
+    if(page == state.pages.end()) {
+      if(state.pages.size() >= MAX_PAGES) state.pages.clear();
+      state.pages.insert(std::make_pair(variants[i].first, std::make_pair(variants[i].second, content)));
+      continue;
+    }
+    if(page->second.first != variants[i].second)
+      ++(distance(page->second.second, content) <= this->options_.max_distance ? state.equal : state.different);
+    page->second = std::make_pair(variants[i].second, content);
+    // A single variant with different content in ten keeps the parameter
+    state.stripped = state.equal >= this->options_.min_evidence && state.different * 10 < state.equal;
+  }
+}
+
+crawler_pp::policies::host_analysis crawler_pp::policies::url_analyzer::get_analysis(const string &name){
+  host_analysis result;
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  const std::unordered_map<string, host_state>::const_iterator
+    host(this->hosts_.find(crawler_pp::utils::string_to_lower(name)));
+  if(host == this->hosts_.end()) return result;
+  result.admitted = host->second.admitted;
+  result.suspected = host->second.suspected;
+  result.deferred = host->second.deferred.size();
+  result.rejected = host->second.rejected;
+  result.patterns = host->second.patterns.size();
+  result.parameters = host->second.parameters.size();
+  for(std::unordered_map<string, parameter_state>::const_iterator it(host->second.parameters.begin());
+      it != host->second.parameters.end(); ++it) {
+    if(it->second.stripped) result.stripped.push_back(it->first);
+    if(this->is_suspicious(it->second)) result.suspicious.push_back(it->first);
+  }
+  std::sort(result.stripped.begin(), result.stripped.end());
+  std::sort(result.suspicious.begin(), result.suspicious.end());
+  return result;
+}
+
+vector<crawler_pp::policies::analyzer_decision> crawler_pp::policies::url_analyzer::get_decisions(){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return vector<analyzer_decision>(this->decisions_.begin(), this->decisions_.end());
+}
+
+void crawler_pp::policies::url_analyzer::write_metrics(std::ostream &os){
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  for(std::unordered_map<string, host_state>::const_iterator host(this->hosts_.begin()); host != this->hosts_.end();
+      ++host) {
+    const string label("{host=\"" + host->first + "\"} ");
+    os << "crawler_pp_analyzer_admitted_total" << label << host->second.admitted << "\n"
+       << "crawler_pp_analyzer_suspected_total" << label << host->second.suspected << "\n"
+       << "crawler_pp_analyzer_deferred" << label << host->second.deferred.size() << "\n"
+       << "crawler_pp_analyzer_rejected_total" << label << host->second.rejected << "\n";
+    for(std::unordered_map<string, parameter_state>::const_iterator it(host->second.parameters.begin());
+	it != host->second.parameters.end(); ++it)
+      if(it->second.stripped)
+	os << "crawler_pp_analyzer_stripped_parameter{host=\"" << host->first << "\",parameter=\"" << it->first
+	   << "\"} 1\n";
+  }
+}
@@ -0,0 +1,237 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: url_analyzer.h
+// Description: This header file defines the url_analyzer class, a
+//              canonicalizer (see crawl_policy.h) that detects crawler traps
+//              and variants of the same page per host. It tracks the
+//              cardinality of query parameters and the depth, segment
+//              repetition and numbering patterns of paths over a sliding
+//              window of the discovered uris, learns the parameters that do
+//              not change the content of a page by comparing the content
+//              fingerprints of fetched pages and limits the number of
+//              suspected trap uris per host and window. Suspected uris that
+//              exceed this limit are deferred until the budget of their host
+//              refills.
+// Public interfaces:
+//   * analyzer_options
+//   * analyzer_decision
+//   * host_analysis
+//   * url_analyzer
+// ============================================================================
+
+
+#ifndef URL_ANALYZER_H
+#define URL_ANALYZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace crawler_pp {
+  namespace policies {
+
+    // Bundles all parameters of an url_analyzer.
+    struct analyzer_options {
+      // The number of discovered uris per host in the sliding window, at
+      // least 1
+      size_t window = 512;
+      // Paths with more segments are suspected traps
+      size_t max_depth = 12;
+      // Paths that contain a segment this often are suspected traps
+      size_t max_repetitions = 3;
+      // A parameter with more distinct values in the window is suspicious
+      // unless it was seen to change the content of pages
+      size_t max_cardinality = 64;
+      // A numbering pattern of paths and parameter names (e.g.
+      // "/calendar/#/#?view") with more distinct uris in the window is
+      // suspected if most of its fetched pages have the same content
+      size_t max_pattern_size = 256;
+      // The number of suspected uris that are admitted per host within the
+      // window, i.e. the budget refills while further uris are discovered
+      size_t trap_budget = 64;
+      // The number of suspected uris per host that are deferred until the
+      // trap budget refills, further suspected uris are rejected
+      size_t max_deferred = 4096;
+      // The number of hosts whose state is kept, the state of the least
+      // recently discovered host is dropped first and its deferred uris are
+      // released
+      size_t max_hosts = 65536;
+      // The number of page pairs that differ only in a parameter and have
+      // the same content before the parameter is stripped
+      size_t min_evidence = 3;
+      // The maximum number of different bits of the content fingerprints of
+      // two pages with the same content
+      unsigned max_distance = 2;
+      // The parameters (lower case) that are always stripped, a trailing
+      // '*' matches all parameters with that prefix
+      std::vector<std::string> strip_parameters = {"utm_*", "gclid", "fbclid", "msclkid", "phpsessid",
+						   "jsessionid", "sessionid", "aspsessionid"};
+      // The number of recent decisions that are kept for inspection
+      size_t max_decisions = 1024;
+    }; // end of struct analyzer_options
+
+    // A suspected or rejected uri
+    struct analyzer_decision {
+      // The canonical uri
+      std::string uri;
+      // False if the uri was deferred or rejected since the trap budget of
+      // its host was exhausted
+      bool admitted;
+      // The trap signal, e.g. "depth 14" or "parameter sid"
+      std::string reason;
+    }; // end of struct analyzer_decision
+
+    // The state of a single host
+    struct host_analysis {
+      // The uris without a trap signal
+      uint64_t admitted = 0;
+      // The suspected uris that were admitted within the trap budget,
+      // including the released deferred uris
+      uint64_t suspected = 0;
+      // The suspected uris that are deferred currently
+      uint64_t deferred = 0;
+      // The suspected uris that were rejected since too many uris were
+      // deferred
+      uint64_t rejected = 0;
+      // The parameters that were learned to be stripped
+      std::vector<std::string> stripped;
+      // The parameters whose cardinality marks uris as suspected
+      std::vector<std::string> suspicious;
+      // The numbering patterns and parameters whose state is kept, they are
+      // dropped once they left the window and were not observed within it
+      size_t patterns = 0;
+      size_t parameters = 0;
+    }; // end of struct host_analysis
+
+    // This class canonicalizes uris per host and filters crawler traps. All
+    // methods are thread safe.
+    class url_analyzer {
+    public:
+      // This constructor takes the parameters of the analyzer.
+      url_analyzer(const analyzer_options& = analyzer_options());
+      // The move constructor is required by crawl_frontend.
+      url_analyzer(url_analyzer&&);
+      // Removes the parameters that are stripped always or were learned to
+      // be stripped for the host of the passed normalized uri.
+      void canonicalize(std::string&);
+      // Adds the passed canonical uri to the window of its host and returns
+      // false if it is a suspected trap and the trap budget of the host is
+      // exhausted. Such an uri is deferred and released later, see release.
+      // An uri that is still in the window or deferred is not added again,
+      // the decision on its discovery is returned.
+      bool admit(const std::string&);
+      // Moves the deferred uris that were admitted since the trap budget of
+      // their host refilled to the passed vector.
+      void release(std::vector<std::string>&);
+      // Learns from the content fingerprint (see crawler_pp::utils::simhash)
+      // of the fetched page with the passed normalized uri.
+      void observe(const std::string&, uint64_t);
+      // Returns the state of the passed host (authority).
+      host_analysis get_analysis(const std::string&);
+      // Returns the recent suspected and rejected uris, the oldest first.
+      std::vector<analyzer_decision> get_decisions();
+      // Writes the counters and learned parameters of all hosts in the
+      // Prometheus text format.
+      void write_metrics(std::ostream&);
+    private:
+      // The values and the content evidence of a parameter
+      struct parameter_state {
+	// The occurrences of each value hash in the window
+	std::unordered_map<uint64_t, unsigned> values;
+	// The last value hash and content fingerprint of each uri without
+	// this parameter
+	std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> > pages;
+	// The page pairs with the same and with different content
+	unsigned equal = 0;
+	unsigned different = 0;
+	bool stripped = false;
+	// The value of host_state::touched when the parameter was discovered
+	// or observed the last time
+	uint64_t touched = 0;
+      };
+      // The distinct uris and the content evidence of a numbering pattern
+      struct pattern_state {
+	std::unordered_map<uint64_t, unsigned> uris;
+	uint64_t fingerprint = 0;
+	bool observed = false;
+	unsigned equal = 0;
+	unsigned different = 0;
+	// The value of host_state::touched when the pattern was discovered or
+	// observed the last time
+	uint64_t touched = 0;
+      };
+      // The decision on a discovered uri
+      struct uri_state {
+	// False if the uri is deferred or was rejected
+	bool admitted;
+	bool deferred;
+	// True while the uri is in the window
+	bool in_window;
+      };
+      // A discovered uri in the window
+      struct window_entry {
+	uint64_t uri;
+	uint64_t pattern;
+	std::vector<std::pair<std::string, uint64_t> > parameters;
+      };
+      struct host_state {
+	std::deque<window_entry> window;
+	std::unordered_map<std::string, parameter_state> parameters;
+	std::unordered_map<uint64_t, pattern_state> patterns;
+	// The number of discovered uris and the numbers of the discovered uri
+	// at which each suspected uri of the window was admitted
+	uint64_t discovered = 0;
+	std::deque<uint64_t> spent;
+	std::deque<std::string> deferred;
+	// The decisions on the uris of the window and on the deferred uris, a
+	// rediscovered uri gets its decision again without spending budget
+	std::unordered_map<uint64_t, uri_state> known;
+	// The number of discovered and observed uris, the evidence of patterns
+	// and parameters that were not touched within as many uris as the
+	// window holds is dropped
+	uint64_t touched = 0;
+	// The position of the host in recent_
+	std::list<std::string>::iterator recent;
+	uint64_t admitted = 0;
+	uint64_t suspected = 0;
+	uint64_t rejected = 0;
+      };
+
+      // Returns true if the passed parameter is stripped for every host.
+      bool strip_always(const std::string&) const;
+      // Returns true if the passed parameter marks uris as suspected.
+      bool is_suspicious(const parameter_state&) const;
+      // Returns the trap signal of the passed path and window entry or an
+      // empty string.
+      std::string find_trap(const host_state&, const std::string&, const window_entry&) const;
+      // Counts a discovered or observed uri of the passed host and drops the
+      // patterns and parameters that are not in the window and were not
+      // touched within the window, learned parameters are kept up to a
+      // limit.
+      void touch(host_state&);
+      // Returns the state of the passed host and marks it as the most
+      // recently discovered one. The state of the least recently discovered
+      // host is dropped if more than max_hosts are known, its deferred uris
+      // are moved to released_.
+      host_state& get_host(const std::string&);
+
+      analyzer_options options_;
+      std::mutex mutex_;
+      std::unordered_map<std::string, host_state> hosts_;
+      // The known hosts, the most recently discovered first
+      std::list<std::string> recent_;
+      // The deferred uris that were admitted but not taken by release yet
+      std::vector<std::string> released_;
+      std::deque<analyzer_decision> decisions_;
+    }; // end of class url_analyzer
+  } // end of namespace policies
+} // end of namespace crawler_pp
+
+#endif // URL_ANALYZER_H
@@ -8,14 +8,21 @@
 //   * string_to_upper
 //   * merge_arrays
 //   * to_string
+//   * fingerprint
+//   * simhash
+//   * uri_authority
+//   * peak_memory_usage
 // ============================================================================
 
 #include "utils.h"
 
 #include <cctype>
+#include <cstring>
 #include <algorithm>
 #include <sstream>
 
+#include <sys/resource.h>
+
 using std::string;
 
 string crawler_pp::utils::string_to_lower(const string &str){
@@ -29,3 +36,89 @@ string crawler_pp::utils::string_to_upper(const string &str){
   transform(result.begin(), result.end(), result.begin(), toupper);
   return result;
 }
+
+uint64_t crawler_pp::utils::fingerprint(const string &str){
+  const uint64_t m(0xc6a4a7935bd1e995ULL);
+  const int r(47);
+  const size_t len(str.size());
+  const char *data(str.data());
+  uint64_t h(0x9747b28c1f2d5e3bULL ^ (len * m));
+
+  for(size_t i(0); i + 8 <= len; i += 8){
+    uint64_t k;
+    std::memcpy(&k, data + i, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+
+  const unsigned char *tail(reinterpret_cast<const unsigned char*>(data) + (len & ~size_t(7)));
+  switch(len & 7){
+  case 7: h ^= uint64_t(tail[6]) << 48;
+    // fall through
+  case 6: h ^= uint64_t(tail[5]) << 40;
+    // fall through
+  case 5: h ^= uint64_t(tail[4]) << 32;
+    // fall through
+  case 4: h ^= uint64_t(tail[3]) << 24;
+    // fall through
+  case 3: h ^= uint64_t(tail[2]) << 16;
+    // fall through
+  case 2: h ^= uint64_t(tail[1]) << 8;
+    // fall through
+  case 1: h ^= uint64_t(tail[0]);
+    h *= m;
+  };
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+uint64_t crawler_pp::utils::simhash(const char *data, size_t size){
+  int weights[64] = {0};
+  uint64_t words[3] = {0, 0, 0};
+  size_t count(0);
+  for(size_t i(0); i < size; ) {
+    // A word is a run of letters and digits, non-ASCII bytes are letters
+    while(i < size && !std::isalnum(static_cast<unsigned char>(data[i])) &&
+	  !(static_cast<unsigned char>(data[i]) & 0x80))
+      ++i;
+    const size_t begin(i);
+    while(i < size && (std::isalnum(static_cast<unsigned char>(data[i])) ||
+		       (static_cast<unsigned char>(data[i]) & 0x80)))
+      ++i;
+    if(begin == i) break;
+    words[0] = words[1];
+    words[1] = words[2];
+    words[2] = fingerprint(string(data + begin, i - begin));
+    if(++count < 3) continue;
+    const uint64_t shingle(words[0] ^ ((words[1] << 21) | (words[1] >> 43)) ^ ((words[2] << 42) | (words[2] >> 22)));
+    for(int bit(0); bit != 64; ++bit) weights[bit] += (shingle >> bit) & 1 ? 1 : -1;
+  }
+  // Contents with less than three words are hashed as a whole
+  if(count < 3) return fingerprint(string(data, size));
+  uint64_t result(0);
+  for(int bit(0); bit != 64; ++bit) if(weights[bit] > 0) result |= uint64_t(1) << bit;
+  return result;
+}
+
+string crawler_pp::utils::uri_authority(const string &uri){
+  size_t begin(uri.find("://"));
+  begin = begin == string::npos ? 0 : begin + 3;
+  size_t end(uri.find_first_of("/?#", begin));
+  if(end == string::npos) end = uri.size();
+  const size_t user_info(uri.rfind('@', end));
+  if(user_info != string::npos && user_info >= begin) begin = user_info + 1;
+  return uri.substr(begin, end - begin);
+}
+
+size_t crawler_pp::utils::peak_memory_usage(){
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage)) return 0;
+  // Linux reports ru_maxrss in KiB
+  return static_cast<size_t>(usage.ru_maxrss);
+}
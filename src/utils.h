@@ -8,11 +8,16 @@
 //   * string_to_upper
 //   * merge_arrays
 //   * to_string
+//   * fingerprint
+//   * simhash
+//   * uri_authority
+//   * peak_memory_usage
 // ============================================================================
 
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstdint>
 #include <string>
 
 #include <sstream>
@@ -26,6 +31,23 @@ namespace crawler_pp {
     // Transforms all characters of the passed string to upper case.
     std::string string_to_upper(const std::string&);
 
+    // Returns a 64 bit fingerprint (MurmurHash64A) of the passed string. The
+    // fingerprint of a normalized uri is used as key for the visited set.
+    uint64_t fingerprint(const std::string&);
+
+    // Returns a 64 bit simhash of the passed content that is built from all
+    // shingles of three words. Contents that differ in few words have
+    // fingerprints that differ in few bits.
+    uint64_t simhash(const char*, size_t);
+
+    // Returns the authority (host and port) of the passed absolute uri
+    // without the user information, e.g. "www.example.org:8080" for
+    // "http://user@www.example.org:8080/path".
+    std::string uri_authority(const std::string&);
+
+    // Returns the peak resident set size of this process in KiB.
+    size_t peak_memory_usage();
+
     // Merges two arrays of the same type and returns a const pointer
     // to a const T.
     template<typename T>
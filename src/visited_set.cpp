@@ -0,0 +1,525 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: visited_set.cpp
+// Description: This implementation file implements the visited_set class.
+//              A run file has the following layout, all numbers are stored
+//              in host byte order:
+//                header: magic (8 bytes), key count, Bloom filter bits,
+//                        hash count (4 bytes), index interval (4 bytes),
+//                        index entry count, reserved
+//                keys:   all keys sorted ascending
+//                index:  every index interval-th key
+//                bloom:  the Bloom filter bits
+// Public interfaces:
+//   * visited_set
+// ============================================================================
+
+
+#include "visited_set.h"
+#include "exceptions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using crawler_pp::exceptions::db_exception;
+
+namespace {
+  const char RUN_MAGIC[8] = {'C', 'P', 'P', 'V', 'S', 'E', 'T', '1'};
+  const string RUN_PREFIX("run-");
+  const string RUN_SUFFIX(".vset");
+  const string TMP_SUFFIX(".tmp");
+
+  // The fixed size header of a run file
+  struct run_header {
+    char magic[8];
+    uint64_t count;
+    uint64_t bloom_bits;
+    uint32_t hashes;
+    uint32_t interval;
+    uint64_t index_count;
+    uint64_t reserved;
+  };
+
+  // The second hash of a key for double hashing in the Bloom filter
+  inline uint64_t bloom_step(uint64_t key){
+    return ((key >> 33) | (key << 31)) * 0x9e3779b97f4a7c15ULL | 1;
+  }
+
+  string errno_message(const string &message, const string &path){
+    return message + " " + path + ": " + std::strerror(errno);
+  }
+
+  string run_path(const string &directory, uint64_t sequence){
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(sequence));
+    return directory + "/" + RUN_PREFIX + name + RUN_SUFFIX;
+  }
+
+  // The visited_set that is attached by visited_set::attach
+  std::shared_ptr<crawler_pp::data::visited_set> attached_set;
+} // end of anonymous namespace
+
+// ============================================================================
+// === the run class ==========================================================
+// ============================================================================
+
+// This class represents a single immutable run file that is mapped into
+// memory. The file is removed when an obsolete run is destroyed.
+class crawler_pp::data::visited_set::run {
+public:
+  // Opens and maps the run file with the passed path.
+  run(const string &path) :path_(path), fd_(-1), map_(nullptr), map_size_(0), obsolete_(false) {
+    this->fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(this->fd_ == -1) throw db_exception(errno_message("Could not open run", path));
+    struct stat info;
+    if(::fstat(this->fd_, &info) == -1) {
+      ::close(this->fd_);
+      throw db_exception(errno_message("Could not stat run", path));
+    }
+    this->map_size_ = static_cast<size_t>(info.st_size);
+    if(this->map_size_ < sizeof(run_header)) {
+      ::close(this->fd_);
+      throw db_exception("The run " + path + " is truncated!");
+    }
+    this->map_ = ::mmap(nullptr, this->map_size_, PROT_READ, MAP_SHARED, this->fd_, 0);
+    if(this->map_ == MAP_FAILED) {
+      ::close(this->fd_);
+      throw db_exception(errno_message("Could not map run", path));
+    }
+
+    const run_header *header(static_cast<const run_header*>(this->map_));
+    const size_t expected(sizeof(run_header) +
+			  (header->count + header->index_count) * sizeof(key_type) +
+			  (header->bloom_bits + 63) / 64 * sizeof(uint64_t));
+    if(std::memcmp(header->magic, RUN_MAGIC, sizeof(RUN_MAGIC)) || expected != this->map_size_) {
+      ::munmap(this->map_, this->map_size_);
+      ::close(this->fd_);
+      throw db_exception("The run " + path + " is corrupted!");
+    }
+    this->count_ = header->count;
+    this->bloom_bits_ = header->bloom_bits;
+    this->hashes_ = header->hashes;
+    this->interval_ = header->interval;
+    this->keys_ = reinterpret_cast<const key_type*>(header + 1);
+    this->index_.assign(this->keys_ + this->count_, this->keys_ + this->count_ + header->index_count);
+    this->bloom_ = reinterpret_cast<const uint64_t*>(this->keys_ + this->count_ + header->index_count);
+    // The keys are read sequentially by merges and batched lookups
+    ::madvise(this->map_, this->map_size_, MADV_SEQUENTIAL);
+  }
+
+  run(const run&) = delete;
+  run& operator=(const run&) = delete;
+
+  // Returns false if the key is definitely not contained in this run.
+  bool may_contain(key_type key) const {
+    if(!this->bloom_bits_) return false;
+    const uint64_t step(bloom_step(key));
+    uint64_t hash(key);
+    for(uint32_t i(0); i != this->hashes_; ++i, hash += step) {
+      const uint64_t bit(hash % this->bloom_bits_);
+      if(!(this->bloom_[bit / 64] & (uint64_t(1) << (bit % 64)))) return false;
+    }
+    return true;
+  }
+
+  // Returns the index of the first key in the block that may contain the
+  // passed key, the search starts at the block first_block.
+  size_t block_of(key_type key, size_t first_block) const {
+    vector<key_type>::const_iterator pos(std::upper_bound(this->index_.begin() + first_block,
+							   this->index_.end(), key));
+    return pos == this->index_.begin() ? 0 : static_cast<size_t>(pos - this->index_.begin()) - 1;
+  }
+
+  // Returns true if the key is contained in the block with the passed index.
+  bool block_contains(size_t block, key_type key) const {
+    const key_type *begin(this->keys_ + block * this->interval_);
+    const key_type *end(this->keys_ + std::min<uint64_t>(this->count_, (block + 1) * this->interval_));
+    return std::binary_search(begin, end, key);
+  }
+
+  bool contains(key_type key) const {
+    return this->may_contain(key) && this->block_contains(this->block_of(key, 0), key);
+  }
+
+  // Sets found[i] to true for each of the passed sorted keys that is
+  // contained in this run. The blocks are visited in ascending order.
+  void contains(const vector<key_type> &sorted, vector<char> &found) const {
+    size_t block(0);
+    for(size_t i(0); i != sorted.size(); ++i) {
+      if(found[i] || !this->may_contain(sorted[i])) continue;
+      block = this->block_of(sorted[i], block);
+      if(this->block_contains(block, sorted[i])) found[i] = true;
+    }
+  }
+
+  uint64_t size() const {
+    return this->count_;
+  }
+
+  const key_type* keys() const {
+    return this->keys_;
+  }
+
+  // Marks this run to be removed from disk when it is destroyed.
+  void mark_obsolete() const {
+    this->obsolete_ = true;
+  }
+
+  ~run() {
+    ::munmap(this->map_, this->map_size_);
+    ::close(this->fd_);
+    if(this->obsolete_) ::unlink(this->path_.c_str());
+  }
+private:
+  string path_;
+  int fd_;
+  void *map_;
+  size_t map_size_;
+  uint64_t count_;
+  uint64_t bloom_bits_;
+  uint32_t hashes_;
+  uint32_t interval_;
+  const key_type *keys_;
+  const uint64_t *bloom_;
+  // The sparse index is copied to memory to avoid page faults on lookups
+  vector<key_type> index_;
+  mutable std::atomic<bool> obsolete_;
+}; // end of class run
+
+namespace {
+  // Writes a run file with all keys returned by next (ascending, no
+  // duplicates) to path. max_keys is the upper bound of the key count and
+  // is used to size the Bloom filter.
+  void write_run_file(const string &path, uint64_t max_keys, size_t bits_per_key,
+		      uint32_t interval, const std::function<bool(uint64_t&)> &next){
+    const string tmp_path(path + TMP_SUFFIX);
+    FILE *file(std::fopen(tmp_path.c_str(), "wb"));
+    if(!file) throw db_exception(errno_message("Could not create run", tmp_path));
+    vector<char> buffer(1 << 20);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    run_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, RUN_MAGIC, sizeof(RUN_MAGIC));
+    header.bloom_bits = std::max<uint64_t>(64, max_keys * bits_per_key);
+    // k = ln(2) * bits per key minimizes the false positive rate
+    header.hashes = static_cast<uint32_t>(std::max<size_t>(1, bits_per_key * 69 / 100));
+    header.interval = interval;
+    vector<uint64_t> bloom((header.bloom_bits + 63) / 64, 0);
+    vector<uint64_t> index;
+
+    bool failed(std::fwrite(&header, sizeof(header), 1, file) != 1);
+    uint64_t key;
+    while(!failed && next(key)) {
+      if(header.count % interval == 0) index.push_back(key);
+      const uint64_t step(bloom_step(key));
+      uint64_t hash(key);
+      for(uint32_t i(0); i != header.hashes; ++i, hash += step) {
+	const uint64_t bit(hash % header.bloom_bits);
+	bloom[bit / 64] |= uint64_t(1) << (bit % 64);
+      }
+      failed = std::fwrite(&key, sizeof(key), 1, file) != 1;
+      ++header.count;
+    }
+    header.index_count = index.size();
+    failed = failed ||
+      (!index.empty() && std::fwrite(index.data(), sizeof(uint64_t), index.size(), file) != index.size()) ||
+      std::fwrite(bloom.data(), sizeof(uint64_t), bloom.size(), file) != bloom.size() ||
+      std::fseek(file, 0, SEEK_SET) ||
+      std::fwrite(&header, sizeof(header), 1, file) != 1 ||
+      std::fflush(file) ||
+      ::fsync(fileno(file));
+    failed = std::fclose(file) || failed;
+    if(failed || std::rename(tmp_path.c_str(), path.c_str())) {
+      const string message(errno_message("Could not write run", path));
+      ::unlink(tmp_path.c_str());
+      throw db_exception(message);
+    }
+  }
+} // end of anonymous namespace
+
+// ============================================================================
+// === the visited_set class ==================================================
+// ============================================================================
+crawler_pp::data::visited_set::visited_set(const crawler_pp::data::visited_set::options &opts)
+  :options_(opts), runs_(std::make_shared<run_list>()), flushes_(0), next_run_(0),
+   compaction_requested_(false), busy_(false), stopped_(false) {
+  if(!this->options_.memtable_size || !this->options_.index_interval || !this->options_.max_runs)
+    throw db_exception("Invalid visited_set options!");
+
+  DIR *dir(::opendir(this->options_.directory.c_str()));
+  if(!dir) throw db_exception(errno_message("Could not open directory", this->options_.directory));
+  vector<std::pair<uint64_t, string> > found;
+  while(struct dirent *entry = ::readdir(dir)) {
+    const string name(entry->d_name);
+    if(name.size() > TMP_SUFFIX.size() &&
+       !name.compare(name.size() - TMP_SUFFIX.size(), TMP_SUFFIX.size(), TMP_SUFFIX)) {
+      // A run that was not completely written before a crash
+      ::unlink((this->options_.directory + "/" + name).c_str());
+    } else if(name.size() > RUN_PREFIX.size() + RUN_SUFFIX.size() && !name.compare(0, RUN_PREFIX.size(), RUN_PREFIX) &&
+	      !name.compare(name.size() - RUN_SUFFIX.size(), RUN_SUFFIX.size(), RUN_SUFFIX)) {
+      const string number(name.substr(RUN_PREFIX.size(), name.size() - RUN_PREFIX.size() - RUN_SUFFIX.size()));
+      found.push_back(std::make_pair(std::stoull(number, nullptr, 16), this->options_.directory + "/" + name));
+    }
+  }
+  ::closedir(dir);
+  std::sort(found.begin(), found.end());
+
+  std::shared_ptr<run_list> runs(std::make_shared<run_list>());
+  for(size_t i(0); i != found.size(); ++i) {
+    runs->push_back(std::make_shared<const run>(found[i].second));
+    this->next_run_ = found[i].first + 1;
+  }
+  this->runs_ = runs;
+  this->maintenance_thread_ = std::thread(&crawler_pp::data::visited_set::maintain, this);
+}
+
+bool crawler_pp::data::visited_set::runs_contain(const run_list &runs, key_type key){
+  // Newer runs are smaller, so they are checked first
+  for(run_list::const_reverse_iterator it(runs.rbegin()); it != runs.rend(); ++it)
+    if((*it)->contains(key)) return true;
+  return false;
+}
+
+std::shared_ptr<const crawler_pp::data::visited_set::run_list>
+  crawler_pp::data::visited_set::get_runs(uint64_t *flushes) const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if(flushes) *flushes = this->flushes_;
+  return this->runs_;
+}
+
+bool crawler_pp::data::visited_set::insert(key_type key){
+  // The runs are checked without holding the lock. If a memtable was flushed
+  // in the meantime, the key may have moved from memory to a new run.
+  uint64_t flushes;
+  std::shared_ptr<const run_list> runs(this->get_runs(&flushes));
+  if(runs_contain(*runs, key)) return false;
+
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  if(this->error_) std::rethrow_exception(this->error_);
+  if(flushes != this->flushes_ && runs_contain(*this->runs_, key)) return false;
+  for(size_t i(0); i != this->immutables_.size(); ++i)
+    if(this->immutables_[i]->count(key)) return false;
+  if(!this->memtable_.insert(key).second) return false;
+
+  if(this->memtable_.size() >= this->options_.memtable_size) {
+    // Inserts block while the background thread is more than one memtable
+    // behind, so memory use stays bounded.
+    this->idle_cv_.wait(lock, [this]{ return this->immutables_.size() < 2 || this->error_; });
+    this->immutables_.push_back(std::make_shared<const std::unordered_set<key_type> >(std::move(this->memtable_)));
+    this->memtable_ = std::unordered_set<key_type>();
+    this->maintenance_cv_.notify_one();
+  }
+  return true;
+}
+
+bool crawler_pp::data::visited_set::contains(key_type key) const {
+  std::shared_ptr<const run_list> runs;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if(this->memtable_.count(key)) return true;
+    for(size_t i(0); i != this->immutables_.size(); ++i)
+      if(this->immutables_[i]->count(key)) return true;
+    runs = this->runs_;
+  }
+  return runs_contain(*runs, key);
+}
+
+vector<bool> crawler_pp::data::visited_set::contains(const vector<key_type> &keys) const {
+  vector<key_type> sorted(keys);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  vector<char> found(sorted.size(), false);
+
+  std::shared_ptr<const run_list> runs;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    for(size_t i(0); i != sorted.size(); ++i) {
+      found[i] = this->memtable_.count(sorted[i]) != 0;
+      for(size_t j(0); !found[i] && j != this->immutables_.size(); ++j)
+	found[i] = this->immutables_[j]->count(sorted[i]) != 0;
+    }
+    runs = this->runs_;
+  }
+  for(run_list::const_reverse_iterator it(runs->rbegin()); it != runs->rend(); ++it)
+    (*it)->contains(sorted, found);
+
+  vector<bool> result(keys.size());
+  for(size_t i(0); i != keys.size(); ++i)
+    result[i] = found[std::lower_bound(sorted.begin(), sorted.end(), keys[i]) - sorted.begin()];
+  return result;
+}
+
+void crawler_pp::data::visited_set::flush(){
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  if(!this->memtable_.empty()) {
+    this->immutables_.push_back(std::make_shared<const std::unordered_set<key_type> >(std::move(this->memtable_)));
+    this->memtable_ = std::unordered_set<key_type>();
+    this->maintenance_cv_.notify_one();
+  }
+  this->idle_cv_.wait(lock, [this]{ return (this->immutables_.empty() && !this->busy_) || this->error_; });
+  if(this->error_) std::rethrow_exception(this->error_);
+}
+
+void crawler_pp::data::visited_set::compact(){
+  this->flush();
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->compaction_requested_ = true;
+  this->maintenance_cv_.notify_one();
+  this->idle_cv_.wait(lock, [this]{
+      return (!this->compaction_requested_ && !this->busy_) || this->error_;
+    });
+  if(this->error_) std::rethrow_exception(this->error_);
+}
+
+size_t crawler_pp::data::visited_set::run_count() const {
+  return this->get_runs(nullptr)->size();
+}
+
+std::shared_ptr<const crawler_pp::data::visited_set::run>
+  crawler_pp::data::visited_set::write_run(vector<key_type> &&keys){
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    sequence = this->next_run_++;
+  }
+  const string path(run_path(this->options_.directory, sequence));
+  size_t pos(0);
+  write_run_file(path, keys.size(), this->options_.bloom_bits_per_key,
+		 static_cast<uint32_t>(this->options_.index_interval),
+		 [&keys, &pos](uint64_t &key){
+		   if(pos == keys.size()) return false;
+		   key = keys[pos++];
+		   return true;
+		 });
+  return std::make_shared<const run>(path);
+}
+
+std::shared_ptr<const crawler_pp::data::visited_set::run>
+  crawler_pp::data::visited_set::merge_runs(const run_list &runs){
+  typedef std::pair<key_type, size_t> cursor;
+  std::priority_queue<cursor, vector<cursor>, std::greater<cursor> > heap;
+  vector<uint64_t> positions(runs.size(), 0);
+  uint64_t max_keys(0);
+  for(size_t i(0); i != runs.size(); ++i) {
+    max_keys += runs[i]->size();
+    if(runs[i]->size()) heap.push(cursor(runs[i]->keys()[0], i));
+  }
+
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    sequence = this->next_run_++;
+  }
+  const string path(run_path(this->options_.directory, sequence));
+  bool has_last(false);
+  key_type last(0);
+  write_run_file(path, max_keys, this->options_.bloom_bits_per_key,
+		 static_cast<uint32_t>(this->options_.index_interval),
+		 [&](uint64_t &key){
+		   while(!heap.empty()) {
+		     const cursor top(heap.top());
+		     heap.pop();
+		     if(++positions[top.second] != runs[top.second]->size())
+		       heap.push(cursor(runs[top.second]->keys()[positions[top.second]], top.second));
+		     if(has_last && top.first == last) continue;
+		     has_last = true;
+		     last = key = top.first;
+		     return true;
+		   }
+		   return false;
+		 });
+  return std::make_shared<const run>(path);
+}
+
+void crawler_pp::data::visited_set::maintain(){
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  while(true) {
+    this->maintenance_cv_.wait(lock, [this]{
+	return this->stopped_ || !this->immutables_.empty() || this->compaction_requested_ ||
+	  this->runs_->size() > this->options_.max_runs;
+      });
+    try {
+      // Flushes are preferred, unless the runs pile up faster than they are
+      // compacted, which would slow down all lookups.
+      const bool overdue(!this->stopped_ && this->runs_->size() > 2 * this->options_.max_runs);
+      if(!this->immutables_.empty() && !overdue) {
+	memtable_ptr memtable(this->immutables_.front());
+	this->busy_ = true;
+	lock.unlock();
+	vector<key_type> keys(memtable->begin(), memtable->end());
+	std::sort(keys.begin(), keys.end());
+	std::shared_ptr<const run> written(this->write_run(std::move(keys)));
+	lock.lock();
+	std::shared_ptr<run_list> runs(std::make_shared<run_list>(*this->runs_));
+	runs->push_back(written);
+	this->runs_ = runs;
+	++this->flushes_;
+	this->immutables_.erase(this->immutables_.begin());
+      } else if(!this->stopped_ && (overdue || this->runs_->size() > this->options_.max_runs ||
+				    (this->compaction_requested_ && this->runs_->size() > 1))) {
+	// Only this thread modifies runs_, so the snapshot stays a prefix of
+	// the run list while the merge is running.
+	std::shared_ptr<const run_list> merged_runs(this->runs_);
+	this->busy_ = true;
+	this->compaction_requested_ = false;
+	lock.unlock();
+	std::shared_ptr<const run> merged(this->merge_runs(*merged_runs));
+	lock.lock();
+	std::shared_ptr<run_list> runs(std::make_shared<run_list>(1, merged));
+	runs->insert(runs->end(), this->runs_->begin() + merged_runs->size(), this->runs_->end());
+	for(size_t i(0); i != merged_runs->size(); ++i) (*merged_runs)[i]->mark_obsolete();
+	this->runs_ = runs;
+      } else {
+	this->compaction_requested_ = false;
+	if(this->stopped_) break;
+      }
+    } catch(...) {
+      if(!lock.owns_lock()) lock.lock();
+      // The keys of a failed flush stay in memory, further writes are
+      // rejected by rethrowing the error.
+      this->error_ = std::current_exception();
+      this->busy_ = false;
+      this->idle_cv_.notify_all();
+      break;
+    }
+    this->busy_ = false;
+    this->idle_cv_.notify_all();
+  }
+}
+
+void crawler_pp::data::visited_set::attach(std::shared_ptr<crawler_pp::data::visited_set> set){
+  std::atomic_store(&attached_set, set);
+}
+
+std::shared_ptr<crawler_pp::data::visited_set> crawler_pp::data::visited_set::get_attached(){
+  return std::atomic_load(&attached_set);
+}
+
+crawler_pp::data::visited_set::~visited_set(){
+  try {
+    this->flush();
+  } catch(...) {
+    // The destructor must not throw, the keys of the memtable are lost
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stopped_ = true;
+  }
+  this->maintenance_cv_.notify_one();
+  this->maintenance_thread_.join();
+}
@@ -0,0 +1,129 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: visited_set.h
+// Description: This header file defines the visited_set class, a disk backed
+//              log-structured merge set of uri fingerprints. Inserts are
+//              buffered in memory and flushed as sorted immutable runs, each
+//              run has a Bloom filter and a sparse index. Runs are compacted
+//              by a background thread.
+// Public interfaces:
+//   * visited_set
+// ============================================================================
+
+
+#ifndef VISITED_SET_H
+#define VISITED_SET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace crawler_pp {
+  namespace data {
+
+    // This class stores the fingerprints of all visited uris, see
+    // crawler_pp::utils::fingerprint. All methods are thread safe.
+    class visited_set {
+    public:
+      // The type of the keys stored in a visited_set
+      typedef uint64_t key_type;
+
+      // Bundles all parameters of a visited_set.
+      struct options {
+	// The directory that contains the run files, it must exist
+	std::string directory;
+	// The number of keys that are buffered in memory before they are
+	// flushed to a new run
+	size_t memtable_size = 1 << 20;
+	// The number of runs that triggers a compaction of all runs
+	size_t max_runs = 8;
+	// The number of Bloom filter bits per key
+	size_t bloom_bits_per_key = 10;
+	// Every index_interval-th key of a run is stored in the sparse index
+	size_t index_interval = 128;
+      };
+
+      // This constructor opens all runs found in options.directory and
+      // starts the background thread that flushes and compacts the runs. If
+      // the directory or a run cannot be read the
+      // crawler_pp::exceptions::db_exception is thrown.
+      visited_set(const options&);
+      // A visited_set cannot be copied, since it owns the run files.
+      visited_set(const visited_set&) = delete;
+      visited_set& operator=(const visited_set&) = delete;
+      // Inserts the passed key. Returns true if the key was not contained
+      // before, otherwise false is returned.
+      bool insert(key_type);
+      // Returns true if the passed key is contained in this set.
+      bool contains(key_type) const;
+      // Returns for each of the passed keys whether it is contained in this
+      // set. The keys are sorted internally, so each run is read by a single
+      // sequential merge instead of one random read per key.
+      std::vector<bool> contains(const std::vector<key_type>&) const;
+      // Writes all buffered keys to a new run and blocks until all runs
+      // are written.
+      void flush();
+      // Blocks until all buffered keys are flushed and all runs are
+      // compacted to a single run.
+      void compact();
+      // Returns the number of runs that are currently stored on disk.
+      size_t run_count() const;
+      // Makes the passed visited_set the backend of
+      // crawler_pp::data::uri::is_known<visited_uri> and
+      // crawler_pp::data::visited_uri::persist. Passing nullptr detaches the
+      // current visited_set.
+      static void attach(std::shared_ptr<visited_set>);
+      // Returns the attached visited_set or nullptr if none is attached.
+      static std::shared_ptr<visited_set> get_attached();
+      // The destructor flushes all buffered keys and stops the background
+      // thread.
+      ~visited_set();
+    private:
+      class run;
+      typedef std::vector<std::shared_ptr<const run> > run_list;
+      typedef std::shared_ptr<const std::unordered_set<key_type> > memtable_ptr;
+
+      // Returns a snapshot of the current runs together with the number of
+      // flushes that produced them.
+      std::shared_ptr<const run_list> get_runs(uint64_t*) const;
+      // Returns true if one of the passed runs contains the passed key.
+      static bool runs_contain(const run_list&, key_type);
+      // The function of the background thread
+      void maintain();
+      // Writes the passed keys to a new run file and returns the opened run.
+      std::shared_ptr<const run> write_run(std::vector<key_type>&&);
+      // Merges all passed runs to a single new run.
+      std::shared_ptr<const run> merge_runs(const run_list&);
+
+      options options_;
+      // Guards all following members
+      mutable std::mutex mutex_;
+      std::condition_variable maintenance_cv_;
+      std::condition_variable idle_cv_;
+      // The keys that are not flushed yet
+      std::unordered_set<key_type> memtable_;
+      // Memtables that are being written by the background thread
+      std::vector<memtable_ptr> immutables_;
+      // The runs on disk, newest last; replaced as a whole (copy on write)
+      std::shared_ptr<const run_list> runs_;
+      // Incremented each time a memtable is turned into a run
+      uint64_t flushes_;
+      // The sequence number of the next run file
+      uint64_t next_run_;
+      bool compaction_requested_;
+      bool busy_;
+      bool stopped_;
+      // The error that stopped the background thread
+      std::exception_ptr error_;
+      std::thread maintenance_thread_;
+    }; // end of class visited_set
+  } // end of namespace data
+} // end of namespace crawler_pp
+
+#endif // VISITED_SET_H
@@ -0,0 +1,259 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: warc_reader.cpp
+// Description: This implementation file implements the warc_reader class
+//              that reads the records of a WARC file as a stream.
+// Public interfaces:
+//   * warc_record
+//   * warc_reader
+//   * read_record
+// ============================================================================
+
+
+#include "warc_reader.h"
+#include "exceptions.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using crawler_pp::exceptions::warc_exception;
+
+namespace {
+  // The size of the inflate buffer of a compressed file, grows for larger
+  // records
+  const size_t BUFFER_SIZE(1 << 20);
+  // Record headers must not be larger than this value
+  const size_t MAX_HEADER_SIZE(1 << 20);
+  // The maximum factor by which deflate expands its input
+  const size_t MAX_INFLATE_RATIO(1032);
+  const char HEADER_END[] = "\r\n\r\n";
+} // end of anonymous namespace
+
+// ============================================================================
+// === the warc_record struct =================================================
+// ============================================================================
+string crawler_pp::warc::warc_record::get_header(const string &name) const {
+  const string lower(crawler_pp::utils::string_to_lower(name));
+  for(size_t i(0); i != this->headers.size(); ++i)
+    if(crawler_pp::utils::string_to_lower(this->headers[i].first) == lower)
+      return this->headers[i].second;
+  return "";
+}
+
+// ============================================================================
+// === the warc_reader class ==================================================
+// ============================================================================
+crawler_pp::warc::warc_reader::warc_reader(const string &path)
+  :path_(path), fd_(-1), map_(nullptr), map_size_(0), compressed_(false), data_(nullptr),
+   begin_(0), end_(0), offset_(0) {
+  this->fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(this->fd_ == -1) throw warc_exception(std::strerror(errno), path);
+  struct stat info;
+  if(::fstat(this->fd_, &info) == -1) {
+    ::close(this->fd_);
+    throw warc_exception(std::strerror(errno), path);
+  }
+  this->map_size_ = static_cast<size_t>(info.st_size);
+  if(this->map_size_) {
+    void *map(::mmap(nullptr, this->map_size_, PROT_READ, MAP_SHARED, this->fd_, 0));
+    if(map == MAP_FAILED) {
+      ::close(this->fd_);
+      throw warc_exception(std::strerror(errno), path);
+    }
+    ::madvise(map, this->map_size_, MADV_SEQUENTIAL);
+    this->map_ = static_cast<const unsigned char*>(map);
+  }
+
+  this->compressed_ = this->map_size_ >= 2 && this->map_[0] == 0x1f && this->map_[1] == 0x8b;
+  if(this->compressed_) {
+    std::memset(&this->stream_, 0, sizeof(this->stream_));
+    // 16 + MAX_WBITS selects the gzip format
+    if(inflateInit2(&this->stream_, 16 + MAX_WBITS) != Z_OK) {
+      ::munmap(const_cast<unsigned char*>(this->map_), this->map_size_);
+      ::close(this->fd_);
+      throw warc_exception("Could not initialize zlib", path);
+    }
+    this->stream_.next_in = const_cast<unsigned char*>(this->map_);
+    this->stream_.avail_in = static_cast<uInt>(std::min<size_t>(this->map_size_, UINT32_MAX));
+    this->buffer_.resize(BUFFER_SIZE);
+    this->data_ = this->buffer_.data();
+  } else {
+    this->data_ = reinterpret_cast<const char*>(this->map_);
+    this->end_ = this->map_size_;
+  }
+}
+
+bool crawler_pp::warc::warc_reader::fill(size_t size){
+  while(this->end_ - this->begin_ < size) {
+    if(!this->compressed_) return false;
+    const size_t consumed(this->stream_.next_in - this->map_);
+    if(!this->stream_.avail_in && consumed == this->map_size_) return false;
+    if(!this->stream_.avail_in)
+      this->stream_.avail_in = static_cast<uInt>(std::min<size_t>(this->map_size_ - consumed, UINT32_MAX));
+
+    // Move the unread bytes to the front and grow the buffer if the
+    // requested size does not fit
+    if(this->begin_) {
+      std::memmove(this->buffer_.data(), this->buffer_.data() + this->begin_, this->end_ - this->begin_);
+      this->end_ -= this->begin_;
+      this->begin_ = 0;
+    }
+    // The buffer grows with the inflated data rather than the requested
+    // size, which is taken from the untrusted Content-Length
+    if(this->buffer_.size() - this->end_ < BUFFER_SIZE / 4 || this->buffer_.size() < size)
+      this->buffer_.resize(this->buffer_.size() * 2);
+    this->data_ = this->buffer_.data();
+
+    this->stream_.next_out = reinterpret_cast<unsigned char*>(this->buffer_.data() + this->end_);
+    this->stream_.avail_out = static_cast<uInt>(this->buffer_.size() - this->end_);
+    const int result(inflate(&this->stream_, Z_NO_FLUSH));
+    this->end_ = this->buffer_.size() - this->stream_.avail_out;
+    if(result == Z_STREAM_END) {
+      // A .warc.gz file usually consists of one gzip member per record. The
+      // stream is reset even if the input window ends with the member, the
+      // next window may hold further members and the end of the file is
+      // detected above.
+      inflateReset(&this->stream_);
+    } else if(result != Z_OK) {
+      throw warc_exception(this->stream_.msg ? this->stream_.msg : "Could not inflate data", this->path_);
+    }
+  }
+  return true;
+}
+
+size_t crawler_pp::warc::warc_reader::find_header_end(){
+  size_t searched(0);
+  while(true) {
+    const size_t available(this->end_ - this->begin_);
+    const char *begin(this->data_ + this->begin_);
+    const char *found(std::search(begin + searched, begin + available, HEADER_END, HEADER_END + 4));
+    if(found != begin + available) return found - begin + 4;
+    if(available > MAX_HEADER_SIZE)
+      throw warc_exception("The record header is too large", this->path_);
+    // The end marker may start in the last three bytes
+    searched = available < 3 ? 0 : available - 3;
+    if(!this->fill(available + 1)) return 0;
+  }
+}
+
+bool crawler_pp::warc::warc_reader::next(crawler_pp::warc::warc_record &record){
+  // Records are separated by "\r\n\r\n"
+  while(this->fill(1) && (this->data_[this->begin_] == '\r' || this->data_[this->begin_] == '\n')) {
+    ++this->begin_;
+    ++this->offset_;
+  }
+  if(!this->fill(1)) return false;
+
+  const size_t header_size(this->find_header_end());
+  if(!header_size) throw warc_exception("The last record is truncated", this->path_);
+  const char *header(this->data_ + this->begin_);
+  const char *header_end(header + header_size - 2);
+  const char *line_end(std::search(header, header_end, HEADER_END, HEADER_END + 2));
+  if(line_end - header < 5 || std::memcmp(header, "WARC/", 5))
+    throw warc_exception("The record at offset " + std::to_string(this->offset_) +
+			 " does not start with a WARC version", this->path_);
+
+  record.headers.clear();
+  record.type.clear();
+  record.target_uri.clear();
+  record.date.clear();
+  bool has_length(false);
+  size_t content_length(0);
+  for(const char *line(line_end + 2); line < header_end; line = line_end + 2) {
+    line_end = std::search(line, header_end, HEADER_END, HEADER_END + 2);
+    const char *colon(std::find(line, line_end, ':'));
+    if(colon == line_end) continue;
+    const char *value(colon + 1);
+    while(value != line_end && (*value == ' ' || *value == '\t')) ++value;
+    record.headers.push_back(std::make_pair(string(line, colon), string(value, line_end)));
+    const string name(crawler_pp::utils::string_to_lower(record.headers.back().first));
+    if(name == "warc-type") {
+      record.type = record.headers.back().second;
+    } else if(name == "warc-target-uri") {
+      record.target_uri = record.headers.back().second;
+      // WARC/1.0 allows the uri to be enclosed in angle brackets
+      if(record.target_uri.size() > 1 && record.target_uri[0] == '<' &&
+	 record.target_uri[record.target_uri.size() - 1] == '>')
+	record.target_uri = record.target_uri.substr(1, record.target_uri.size() - 2);
+    } else if(name == "warc-date") {
+      record.date = record.headers.back().second;
+    } else if(name == "content-length") {
+      try {
+	content_length = static_cast<size_t>(std::stoull(record.headers.back().second));
+	has_length = true;
+      } catch(std::exception&) {
+	// handled below
+      }
+    }
+  }
+  if(!has_length)
+    throw warc_exception("The record at offset " + std::to_string(this->offset_) +
+			 " has no valid Content-Length", this->path_);
+
+  // The Content-Length is not trusted, the content must fit into the rest
+  // of the file
+  const size_t consumed(this->compressed_ ? this->stream_.next_in - this->map_ : this->map_size_);
+  const size_t remaining(this->end_ - this->begin_ - header_size + (this->map_size_ - consumed) * MAX_INFLATE_RATIO);
+  if(content_length > remaining)
+    throw warc_exception("The record at offset " + std::to_string(this->offset_) +
+			 " is larger than the rest of the file", this->path_);
+  if(!this->fill(header_size + content_length))
+    throw warc_exception("The last record is truncated", this->path_);
+  record.content = this->data_ + this->begin_ + header_size;
+  record.content_length = content_length;
+  this->begin_ += header_size + content_length;
+  this->offset_ += header_size + content_length;
+  return true;
+}
+
+size_t crawler_pp::warc::warc_reader::get_offset() const {
+  return this->offset_;
+}
+
+crawler_pp::warc::warc_reader::~warc_reader(){
+  if(this->compressed_) inflateEnd(&this->stream_);
+  if(this->map_) ::munmap(const_cast<unsigned char*>(this->map_), this->map_size_);
+  ::close(this->fd_);
+}
+
+string crawler_pp::warc::read_record(const string &path, uint64_t offset, uint64_t length){
+  const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if(fd == -1) throw warc_exception(std::strerror(errno), path);
+  std::vector<unsigned char> compressed(length);
+  size_t read(0);
+  while(read != length) {
+    const ssize_t result(::pread(fd, compressed.data() + read, length - read, offset + read));
+    if(result <= 0) {
+      ::close(fd);
+      throw warc_exception(result ? std::strerror(errno) : "The record is truncated", path);
+    }
+    read += static_cast<size_t>(result);
+  }
+  ::close(fd);
+
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if(inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) throw warc_exception("Could not initialize zlib", path);
+  stream.next_in = compressed.data();
+  stream.avail_in = static_cast<uInt>(length);
+  string record;
+  char buffer[1 << 16];
+  int result;
+  do {
+    stream.next_out = reinterpret_cast<unsigned char*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    record.append(buffer, sizeof(buffer) - stream.avail_out);
+  } while(result == Z_OK);
+  inflateEnd(&stream);
+  if(result != Z_STREAM_END) throw warc_exception("Could not inflate the record", path);
+  return record;
+}
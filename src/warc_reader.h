@@ -0,0 +1,100 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: warc_reader.h
+// Description: This header file defines the warc_reader class that reads the
+//              records of a WARC file (see ISO 28500) as a stream. The file
+//              is mapped into memory; gzip compressed files (.warc.gz) are
+//              inflated incrementally, i.e. only the current record is held
+//              in memory.
+// Public interfaces:
+//   * warc_record
+//   * warc_reader
+//   * read_record
+// ============================================================================
+
+
+#ifndef WARC_READER_H
+#define WARC_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+namespace crawler_pp {
+  namespace warc {
+
+    // A single record of a WARC file. The content points into memory owned
+    // by the warc_reader and is valid until the next record is read.
+    struct warc_record {
+      // The value of the header WARC-Type, e.g. "response"
+      std::string type;
+      // The value of the header WARC-Target-URI
+      std::string target_uri;
+      // The value of the header WARC-Date
+      std::string date;
+      // All headers of the record in the order of the file
+      std::vector<std::pair<std::string, std::string> > headers;
+      // The content block of the record
+      const char *content;
+      // The size of the content block in bytes
+      size_t content_length;
+      // Returns the value of the passed header (case-insensitive) or an
+      // empty string if the record has no such header.
+      std::string get_header(const std::string&) const;
+    }; // end of struct warc_record
+
+    // This class reads all records of a WARC file one after the other.
+    class warc_reader {
+    public:
+      // This constructor opens and maps the WARC file with the passed path.
+      // If the file cannot be read the
+      // crawler_pp::exceptions::warc_exception is thrown.
+      warc_reader(const std::string&);
+      // A warc_reader cannot be copied, since it owns the mapped file.
+      warc_reader(const warc_reader&) = delete;
+      warc_reader& operator=(const warc_reader&) = delete;
+      // Reads the next record into the passed warc_record. Returns false if
+      // the end of the file is reached. If the file is malformed the
+      // crawler_pp::exceptions::warc_exception is thrown.
+      bool next(warc_record&);
+      // Returns the number of bytes of the (uncompressed) file that were
+      // read so far.
+      size_t get_offset() const;
+      // The destructor unmaps and closes the file.
+      ~warc_reader();
+    private:
+      // Makes at least the passed number of bytes available at
+      // data_ + begin_. Returns false if the file has less bytes left.
+      bool fill(size_t);
+      // Returns the position of the end of the record headers, i.e. the
+      // position after "\r\n\r\n" relative to data_ + begin_, or 0.
+      size_t find_header_end();
+
+      std::string path_;
+      int fd_;
+      const unsigned char *map_;
+      size_t map_size_;
+      bool compressed_;
+      z_stream stream_;
+      // The inflated bytes of a compressed file
+      std::vector<char> buffer_;
+      // The readable bytes: either the mapped file or buffer_
+      const char *data_;
+      size_t begin_;
+      size_t end_;
+      size_t offset_;
+    }; // end of class warc_reader
+
+    // Returns the uncompressed record that is stored as a single gzip member
+    // of the passed length at the passed offset of the passed file, e.g. a
+    // location from a CDX index. If the record cannot be read the
+    // crawler_pp::exceptions::warc_exception is thrown.
+    std::string read_record(const std::string&, uint64_t, uint64_t);
+  } // end of namespace warc
+} // end of namespace crawler_pp
+
+#endif // WARC_READER_H
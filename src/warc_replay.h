@@ -0,0 +1,147 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: warc_replay.h
+// Description: This header file defines the warc_replay class template that
+//              drives the crawl pipeline with the records of WARC files
+//              instead of live downloads, i.e. each response record passes
+//              the link extraction, the normalization, the dedup and the
+//              frontier of a crawl_frontend. This allows to measure the
+//              throughput of the pipeline on a fixed corpus without network.
+// Public interfaces:
+//   * replay_stats
+//   * warc_replay
+// ============================================================================
+
+
+#ifndef WARC_REPLAY_H
+#define WARC_REPLAY_H
+
+#include "crawl_frontend.h"
+#include "exceptions.h"
+#include "link_extractor.h"
+#include "page_downloader.h"
+#include "uri.h"
+#include "utils.h"
+#include "warc_reader.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace crawler_pp {
+  namespace warc {
+
+    // The counters of a replay
+    struct replay_stats {
+      // All records read
+      uint64_t records = 0;
+      // The response records read
+      uint64_t responses = 0;
+      // The HTML responses with the status 200 whose links were extracted
+      uint64_t pages = 0;
+      // The size of all records in bytes (uncompressed)
+      uint64_t bytes = 0;
+      // All extracted links
+      uint64_t links = 0;
+      // The links that were pushed to the frontier
+      uint64_t admitted = 0;
+      // The links that were already known or waiting
+      uint64_t duplicates = 0;
+      // The links and target uris that were rejected by the normalization
+      uint64_t rejected = 0;
+      // The time spent in warc_replay::replay
+      std::chrono::duration<double> elapsed = std::chrono::duration<double>(0);
+      // Returns the number of response records per second.
+      double responses_per_second() const {
+	return this->elapsed.count() > 0 ? this->responses / this->elapsed.count() : 0;
+      }
+    }; // end of struct replay_stats
+
+    // Writes the passed replay_stats and the peak memory usage of the
+    // process to the given ostream.
+    inline std::ostream& operator<<(std::ostream &os, const replay_stats &stats){
+      os << "records: " << stats.records << "\n"
+	 << "responses: " << stats.responses << "\n"
+	 << "pages: " << stats.pages << "\n"
+	 << "bytes: " << stats.bytes << "\n"
+	 << "links: " << stats.links << "\n"
+	 << "admitted: " << stats.admitted << "\n"
+	 << "duplicates: " << stats.duplicates << "\n"
+	 << "rejected: " << stats.rejected << "\n"
+	 << "seconds: " << stats.elapsed.count() << "\n"
+	 << "responses/sec: " << stats.responses_per_second() << "\n"
+	 << "MiB/sec: " << (stats.elapsed.count() > 0 ? stats.bytes / stats.elapsed.count() / (1 << 20) : 0) << "\n"
+	 << "peak memory (KiB): " << crawler_pp::utils::peak_memory_usage() << "\n";
+      return os;
+    }
+
+    // This class replays the response records of WARC files through the
+    // passed crawl_frontend: the target uri of each response is marked as
+    // visited and all links of HTML responses are admitted to the frontier.
+    template<typename Policy>
+    class warc_replay {
+    public:
+      // This constructor takes the front end that receives all uris.
+      warc_replay(crawler_pp::policies::crawl_frontend<Policy> &frontend) :frontend_(frontend) {}
+      // Replays all records of the passed WARC file. If the file is
+      // malformed the crawler_pp::exceptions::warc_exception is thrown.
+      void replay(const std::string &path){
+	const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+	warc_reader reader(path);
+	warc_record record;
+	const size_t offset(this->stats_.bytes);
+	while(reader.next(record)) {
+	  ++this->stats_.records;
+	  if(record.type == "response") this->process(record);
+	}
+	this->stats_.bytes = offset + reader.get_offset();
+	this->stats_.elapsed += std::chrono::steady_clock::now() - start;
+      }
+      // A getter for the member stats_
+      const replay_stats& get_stats() const {
+	return this->stats_;
+      }
+    private:
+      // Passes a single response record through the pipeline.
+      void process(const warc_record &record){
+	++this->stats_.responses;
+	crawler_pp::download::http_response response;
+	if(!crawler_pp::download::parse_http_response(record.content, record.content_length, response))
+	  return;
+	std::string target;
+	try {
+	  target = crawler_pp::policies::crawl_frontend<Policy>::normalize(record.target_uri);
+	} catch(crawler_pp::exceptions::uri_exception&) {
+	  ++this->stats_.rejected;
+	  return;
+	}
+	this->frontend_.mark_visited(crawler_pp::data::visited_uri(target, crawler_pp::data::uri::normalized_value()));
+	// The response is analyzed like a live download, see crawl_pipeline
+	this->links_.clear();
+	uint64_t content;
+	if(!crawler_pp::extraction::extract_page(response, target, content, this->links_)) return;
+
+	++this->stats_.pages;
+	this->frontend_.observe(target, content);
+	this->stats_.links += this->links_.size();
+	for(size_t i(0); i != this->links_.size(); ++i) {
+	  try {
+	    if(this->frontend_.admit(this->links_[i])) ++this->stats_.admitted;
+	    else ++this->stats_.duplicates;
+	  } catch(crawler_pp::exceptions::uri_exception&) {
+	    ++this->stats_.rejected;
+	  }
+	}
+      }
+
+      crawler_pp::policies::crawl_frontend<Policy> &frontend_;
+      replay_stats stats_;
+      // The links of the current page, reused to avoid allocations
+      std::vector<std::string> links_;
+    }; // end of class warc_replay
+  } // end of namespace warc
+} // end of namespace crawler_pp
+
+#endif // WARC_REPLAY_H
@@ -0,0 +1,243 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: warc_writer.cpp
+// Description: This implementation file implements the warc_writer class
+//              that writes WARC records as gzip members to rolling files.
+// Public interfaces:
+//   * content_source
+//   * string_source
+//   * warc_writer_options
+//   * warc_record_header
+//   * record_location
+//   * warc_writer
+// ============================================================================
+
+
+#include "warc_writer.h"
+#include "exceptions.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <random>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+using crawler_pp::exceptions::warc_exception;
+
+namespace {
+  // The size of the chunks that are read from a content_source
+  const size_t CHUNK_SIZE(1 << 16);
+  const char RECORD_END[] = "\r\n\r\n";
+
+  // Returns the passed time formatted by strftime in UTC.
+  string format_time(std::chrono::system_clock::time_point time, const char *format){
+    const std::time_t seconds(std::chrono::system_clock::to_time_t(time));
+    std::tm utc;
+    gmtime_r(&seconds, &utc);
+    char buffer[32];
+    return string(buffer, std::strftime(buffer, sizeof(buffer), format, &utc));
+  }
+
+  // Creates the passed file and opens it for writing. Returns nullptr and
+  // sets errno if the file cannot be created, an existing file is never
+  // truncated (EEXIST).
+  std::FILE* create_file(const string &path){
+    const int fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644));
+    if(fd == -1) return nullptr;
+    std::FILE *file(fdopen(fd, "wb"));
+    if(!file) {
+      const int error(errno);
+      ::close(fd);
+      errno = error;
+    }
+    return file;
+  }
+
+  // Returns the media type of the passed Content-Type in lower case without
+  // parameters and whitespace, i.e. the mime type field (m) of a CDX line.
+  // If the media type is empty or malformed, "-" is returned.
+  string cdx_mime(const string &content_type){
+    const string type(content_type.substr(0, content_type.find(';')));
+    const size_t begin(type.find_first_not_of(" \t"));
+    if(begin == string::npos) return "-";
+    const string result(type.substr(begin, type.find_last_not_of(" \t") + 1 - begin));
+    if(result.find_first_of(" \t\r\n") != string::npos) return "-";
+    return crawler_pp::utils::string_to_lower(result);
+  }
+} // end of anonymous namespace
+
+crawler_pp::warc::content_source crawler_pp::warc::string_source(string content){
+  // The content is shared, since a std::function must be copyable
+  std::shared_ptr<string> data(std::make_shared<string>(std::move(content)));
+  std::shared_ptr<size_t> pos(std::make_shared<size_t>(0));
+  return [data, pos](char *buffer, size_t size){
+    const size_t count(std::min(size, data->size() - *pos));
+    std::memcpy(buffer, data->data() + *pos, count);
+    *pos += count;
+    return count;
+  };
+}
+
+crawler_pp::warc::warc_writer::warc_writer(const crawler_pp::warc::warc_writer_options &options)
+  :options_(options), file_(nullptr), index_(nullptr), offset_(0), sequence_(0), output_(CHUNK_SIZE) {
+  std::memset(&this->stream_, 0, sizeof(this->stream_));
+  // 16 + MAX_WBITS selects the gzip format
+  if(deflateInit2(&this->stream_, options.compression_level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+		  Z_DEFAULT_STRATEGY) != Z_OK)
+    throw warc_exception("Could not initialize zlib", options.directory);
+}
+
+string crawler_pp::warc::warc_writer::make_record_id(){
+  static thread_local std::mt19937_64 generator(std::random_device{}());
+  const uint64_t high(generator()), low(generator());
+  // A version 4 (random) UUID
+  char uuid[48];
+  std::snprintf(uuid, sizeof(uuid), "<urn:uuid:%08x-%04x-4%03x-%04x-%012llx>",
+		static_cast<unsigned>(high >> 32), static_cast<unsigned>((high >> 16) & 0xffff),
+		static_cast<unsigned>(high & 0xfff), static_cast<unsigned>(0x8000 | ((low >> 48) & 0x3fff)),
+		static_cast<unsigned long long>(low & 0xffffffffffffULL));
+  return uuid;
+}
+
+string crawler_pp::warc::warc_writer::format_date(std::chrono::system_clock::time_point date){
+  return format_time(date, "%Y-%m-%dT%H:%M:%SZ");
+}
+
+void crawler_pp::warc::warc_writer::open(){
+  const std::chrono::system_clock::time_point now(std::chrono::system_clock::now());
+  // The name may be taken by another process or an earlier run, the next
+  // sequence number is tried then
+  while(true) {
+    char sequence[16];
+    std::snprintf(sequence, sizeof(sequence), "%05u", this->sequence_++);
+    this->filename_ = this->options_.prefix + "-" + format_time(now, "%Y%m%d%H%M%S") + "-" +
+      sequence + ".warc.gz";
+    const string path(this->options_.directory + "/" + this->filename_);
+    this->file_ = create_file(path);
+    if(!this->file_) {
+      if(errno == EEXIST) continue;
+      throw warc_exception(std::strerror(errno), path);
+    }
+    this->index_ = create_file(path + ".cdx");
+    if(this->index_) break;
+    const int error(errno);
+    std::fclose(this->file_);
+    this->file_ = nullptr;
+    ::unlink(path.c_str());
+    if(error != EEXIST) throw warc_exception(std::strerror(error), path + ".cdx");
+  }
+  std::fputs(" CDX N b a m s k r M S V g\n", this->index_);
+  this->offset_ = 0;
+
+  const string fields("software: crawler_pp\r\nformat: WARC File Format 1.0\r\n");
+  crawler_pp::warc::warc_record_header header;
+  header.type = "warcinfo";
+  header.date = now;
+  header.record_id = make_record_id();
+  header.content_type = "application/warc-fields";
+  header.headers.push_back(std::make_pair("WARC-Filename", this->filename_));
+  this->write_record(header, fields.size(), string_source(fields));
+}
+
+void crawler_pp::warc::warc_writer::deflate_chunk(const char *data, size_t size, int flush){
+  this->stream_.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(data));
+  this->stream_.avail_in = static_cast<uInt>(size);
+  int result;
+  do {
+    this->stream_.next_out = this->output_.data();
+    this->stream_.avail_out = static_cast<uInt>(this->output_.size());
+    result = deflate(&this->stream_, flush);
+    if(result == Z_STREAM_ERROR) throw warc_exception("Could not deflate data", this->filename_);
+    const size_t produced(this->output_.size() - this->stream_.avail_out);
+    if(produced && std::fwrite(this->output_.data(), 1, produced, this->file_) != produced)
+      throw warc_exception(std::strerror(errno), this->filename_);
+    this->offset_ += produced;
+  } while(!this->stream_.avail_out || (flush == Z_FINISH && result != Z_STREAM_END));
+}
+
+crawler_pp::warc::record_location
+  crawler_pp::warc::warc_writer::write_record(const crawler_pp::warc::warc_record_header &header,
+					      uint64_t length, const crawler_pp::warc::content_source &source,
+					      bool may_roll){
+  if(!this->file_ || (may_roll && this->offset_ >= this->options_.max_file_size)) {
+    this->close();
+    this->open();
+  }
+
+  string head("WARC/1.0\r\nWARC-Type: " + header.type + "\r\nWARC-Record-ID: " + header.record_id +
+	      "\r\nWARC-Date: " + format_date(header.date) + "\r\n");
+  if(!header.target_uri.empty()) head += "WARC-Target-URI: " + header.target_uri + "\r\n";
+  for(size_t i(0); i != header.headers.size(); ++i)
+    head += header.headers[i].first + ": " + header.headers[i].second + "\r\n";
+  if(!header.content_type.empty()) head += "Content-Type: " + header.content_type + "\r\n";
+  head += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+
+  crawler_pp::warc::record_location location;
+  location.filename = this->filename_;
+  location.offset = this->offset_;
+  deflateReset(&this->stream_);
+  uint64_t written(0);
+  try {
+    this->deflate_chunk(head.data(), head.size(), Z_NO_FLUSH);
+    char chunk[CHUNK_SIZE];
+    for(size_t size; (size = source(chunk, sizeof(chunk))) != 0; written += size)
+      this->deflate_chunk(chunk, size, Z_NO_FLUSH);
+    this->deflate_chunk(RECORD_END, 4, Z_FINISH);
+  } catch(...) {
+    // A partly written gzip member would corrupt the file for readers, so
+    // it is cut off and no further records are appended to this file
+    std::fflush(this->file_);
+    if(ftruncate(fileno(this->file_), static_cast<off_t>(location.offset))) {}
+    this->close();
+    throw;
+  }
+  location.length = this->offset_ - location.offset;
+
+  if(written != length) {
+    // The record is complete as gzip member but its Content-Length is
+    // wrong, so no further records are appended to this file
+    this->close();
+    throw warc_exception("The content of a record has " + std::to_string(written) + " instead of " +
+			 std::to_string(length) + " bytes", location.filename);
+  }
+  return location;
+}
+
+void crawler_pp::warc::warc_writer::write_index(const crawler_pp::warc::record_location &location,
+						const string &uri, std::chrono::system_clock::time_point date,
+						const string &mime, int status){
+  if(!this->index_ || location.filename != this->filename_) return;
+  // The massaged url (N) is the lower case uri without scheme and "www."
+  string key(crawler_pp::utils::string_to_lower(uri));
+  const size_t scheme(key.find("://"));
+  if(scheme != string::npos) key.erase(0, scheme + 3);
+  if(!key.compare(0, 4, "www.")) key.erase(0, 4);
+  std::fprintf(this->index_, "%s %s %s %s %d - - - %llu %llu %s\n", key.c_str(),
+	       format_time(date, "%Y%m%d%H%M%S").c_str(), uri.c_str(), cdx_mime(mime).c_str(),
+	       status, static_cast<unsigned long long>(location.length),
+	       static_cast<unsigned long long>(location.offset), location.filename.c_str());
+}
+
+void crawler_pp::warc::warc_writer::flush(){
+  if(this->file_ && std::fflush(this->file_)) throw warc_exception(std::strerror(errno), this->filename_);
+  if(this->index_ && std::fflush(this->index_))
+    throw warc_exception(std::strerror(errno), this->filename_ + ".cdx");
+}
+
+void crawler_pp::warc::warc_writer::close(){
+  if(this->file_) std::fclose(this->file_);
+  if(this->index_) std::fclose(this->index_);
+  this->file_ = nullptr;
+  this->index_ = nullptr;
+}
+
+crawler_pp::warc::warc_writer::~warc_writer(){
+  this->close();
+  deflateEnd(&this->stream_);
+}
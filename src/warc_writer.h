@@ -0,0 +1,137 @@
+// ============================================================================
+// Author: Lukas Georgieff
+// File: warc_writer.h
+// Description: This header file defines the warc_writer class that writes
+//              WARC records as gzip members (one member per record) to files
+//              that are rolled by size. The content of a record is streamed
+//              from a content_source, i.e. a record is never buffered as a
+//              whole. For each file a CDX index is written.
+// Public interfaces:
+//   * content_source
+//   * string_source
+//   * warc_writer_options
+//   * warc_record_header
+//   * record_location
+//   * warc_writer
+// ============================================================================
+
+
+#ifndef WARC_WRITER_H
+#define WARC_WRITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+namespace crawler_pp {
+  namespace warc {
+
+    // A content_source copies the next bytes of a record content into the
+    // passed buffer of the passed size and returns the number of copied
+    // bytes, 0 marks the end of the content.
+    typedef std::function<size_t(char*, size_t)> content_source;
+
+    // Returns a content_source that reads the passed string.
+    content_source string_source(std::string);
+
+    // Bundles all parameters of a warc_writer.
+    struct warc_writer_options {
+      // The directory that contains the WARC files, it must exist
+      std::string directory;
+      // The prefix of all file names
+      std::string prefix = "crawler_pp";
+      // A new file is started as soon as a file exceeds this size in bytes
+      uint64_t max_file_size = uint64_t(1) << 30;
+      // The zlib compression level
+      int compression_level = Z_DEFAULT_COMPRESSION;
+    }; // end of struct warc_writer_options
+
+    // The headers of a WARC record that are set by the writer's caller.
+    struct warc_record_header {
+      // The value of WARC-Type, e.g. "response"
+      std::string type;
+      // The value of WARC-Target-URI, may be empty
+      std::string target_uri;
+      // The time the content was captured
+      std::chrono::system_clock::time_point date;
+      // The value of WARC-Record-ID, see warc_writer::make_record_id
+      std::string record_id;
+      // The value of Content-Type
+      std::string content_type;
+      // Additional headers, e.g. WARC-Concurrent-To
+      std::vector<std::pair<std::string, std::string> > headers;
+    }; // end of struct warc_record_header
+
+    // The position of a written record. A record can be read by inflating
+    // length bytes at offset of the file.
+    struct record_location {
+      std::string filename;
+      uint64_t offset;
+      uint64_t length;
+    }; // end of struct record_location
+
+    // This class writes WARC records to rolling gzip compressed files. This
+    // class is not thread safe, see crawler_pp::storage::storage_controller.
+    class warc_writer {
+    public:
+      // This constructor takes the parameters of the writer. The first file
+      // is created by the first write_record call.
+      warc_writer(const warc_writer_options&);
+      // A warc_writer cannot be copied, since it owns the open files.
+      warc_writer(const warc_writer&) = delete;
+      warc_writer& operator=(const warc_writer&) = delete;
+      // Writes a single record whose content of the passed length is read
+      // from the passed source and returns its location. If the source
+      // returns more or less bytes than announced or a file cannot be
+      // written the crawler_pp::exceptions::warc_exception is thrown. If
+      // writing fails or the source throws, the partly written record is
+      // removed and the file is closed. If the last parameter is false the
+      // file is not rolled before the record, so concurrent records (e.g.
+      // request and response) share one file.
+      record_location write_record(const warc_record_header&, uint64_t, const content_source&,
+				   bool may_roll = true);
+      // Appends a line to the CDX index of the file that contains the passed
+      // location, see: http://iipc.github.io/warc-specifications/specifications/cdx-format/cdx-2015/
+      // Only the lower-cased media type of the passed Content-Type is
+      // written, e.g. "text/html" for "Text/HTML; charset=UTF-8".
+      void write_index(const record_location&, const std::string &uri,
+		       std::chrono::system_clock::time_point, const std::string &mime, int status);
+      // Flushes all buffered data of the open files. If the data cannot be
+      // written, e.g. since the disk is full, the
+      // crawler_pp::exceptions::warc_exception is thrown.
+      void flush();
+      // Closes the open files, the next record starts a new file.
+      void close();
+      // Returns a new unique WARC-Record-ID, e.g. "<urn:uuid:...>".
+      static std::string make_record_id();
+      // Returns the passed time as WARC-Date (ISO 8601), e.g.
+      // "2014-09-30T12:00:00Z".
+      static std::string format_date(std::chrono::system_clock::time_point);
+      // The destructor closes the open files.
+      ~warc_writer();
+    private:
+      // Starts a new file that begins with a warcinfo record. Existing files
+      // are skipped, not overwritten.
+      void open();
+      // Passes the input of the deflate stream to the file.
+      void deflate_chunk(const char*, size_t, int);
+
+      warc_writer_options options_;
+      std::string filename_;
+      FILE *file_;
+      FILE *index_;
+      uint64_t offset_;
+      unsigned sequence_;
+      z_stream stream_;
+      std::vector<unsigned char> output_;
+    }; // end of class warc_writer
+  } // end of namespace warc
+} // end of namespace crawler_pp
+
+#endif // WARC_WRITER_H